@@ -0,0 +1,327 @@
+﻿#include "ActivationFunctions.h"
+
+#include "Simd.h"
+
+#include <cstring>
+
+float ActivationFunctions::binary_step(const float x)
+{
+    return x >= 0.0f ? 1.0f : 0.0f;
+}
+
+float ActivationFunctions::sign(const float x)
+{
+    if (x > 0) return 1;
+    if (x < 0) return -1;
+    return 0;
+}
+
+float ActivationFunctions::linear(const float x)
+{
+    return x;
+}
+
+float ActivationFunctions::sigmoid(const float x)
+{
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+float ActivationFunctions::tanh(const float x)
+{
+    return std::tanh(x);
+}
+
+float ActivationFunctions::re_lu(const float x)
+{
+    return std::max(0.0f, x);
+}
+
+float ActivationFunctions::leaky_re_lu(const float x)
+{
+    return std::max(0.1f * x, x);
+}
+
+float ActivationFunctions::elu(const float x)
+{
+    return x >= 0 ? x : alpha * (std::exp(x) - 1);
+}
+
+float ActivationFunctions::get_complexity(const sf::Uint8 id)
+{
+    static constexpr float complexities[count] = {0.1f, 0.5f, 1.75f, 2.5f, 1.0f, 1.2f, 3.0f};
+    return complexities[id];
+}
+
+static ActivationFunctions::Mode current_mode = ActivationFunctions::Mode::Exact;
+
+ActivationFunctions::Mode ActivationFunctions::get_mode()
+{
+    return current_mode;
+}
+
+void ActivationFunctions::set_mode(const Mode mode)
+{
+    current_mode = mode;
+}
+
+const char* ActivationFunctions::get_mode_name(const Mode mode)
+{
+    switch(mode)
+    {
+    case Mode::Exact: return "exact";
+    case Mode::Fast: return "fast";
+    }
+    return "unknown";
+}
+
+bool ActivationFunctions::parse_mode(const std::string& name, Mode& out)
+{
+    for(const auto mode : {Mode::Exact, Mode::Fast})
+    {
+        if(name == get_mode_name(mode))
+        {
+            out = mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+// exp(x) = 2^n * 2^f with n = round(x * log2(e)) and f in [-0.5, 0.5], 2^f taken from a
+// degree 5 minimax polynomial (relative error 7.5e-8). Inputs are clamped to where the
+// result stays a normal float. Every level below does the same float operations in the same
+// order, without fused multiply-adds, so they all agree bit for bit.
+namespace FastExp
+{
+    static constexpr float min_x = -87.0f;
+    static constexpr float max_x = 87.0f;
+    static constexpr float log2e = 1.44269504f;
+    // Keeps the sum positive so truncating it rounds down.
+    static constexpr float round_offset = 128.5f;
+    static constexpr int exponent_offset = 128;
+    static constexpr float c0 = 1.00000007f;
+    static constexpr float c1 = 0.693146967f;
+    static constexpr float c2 = 0.240221197f;
+    static constexpr float c3 = 0.0555071332f;
+    static constexpr float c4 = 0.00967554121f;
+    static constexpr float c5 = 0.00132764564f;
+}
+
+static float fast_exp(float x)
+{
+    // Written like max_ps and min_ps, which return the second operand on ties.
+    x = x > FastExp::min_x ? x : FastExp::min_x;
+    x = x < FastExp::max_x ? x : FastExp::max_x;
+    const float t = x * FastExp::log2e;
+    const int n = static_cast<int>(t + FastExp::round_offset) - FastExp::exponent_offset;
+    const float f = t - static_cast<float>(n);
+    float p = FastExp::c5 * f + FastExp::c4;
+    p = p * f + FastExp::c3;
+    p = p * f + FastExp::c2;
+    p = p * f + FastExp::c1;
+    p = p * f + FastExp::c0;
+    const sf::Uint32 scale_bits = static_cast<sf::Uint32>(n + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &scale_bits, sizeof(scale));
+    return p * scale;
+}
+
+static void activate_layer_exact(const sf::Uint8* ids, float* values, const size_t count)
+{
+    using namespace ActivationFunctions;
+    for(size_t i = 0; i < count; i++)
+    {
+        float& x = values[i];
+        switch(static_cast<Id>(ids[i]))
+        {
+        case Id::BinaryStep: x = binary_step(x); break;
+        case Id::Linear: break;
+        case Id::Sigmoid: x = sigmoid(x); break;
+        case Id::Tanh: x = ActivationFunctions::tanh(x); break;
+        case Id::ReLu: x = re_lu(x); break;
+        case Id::LeakyReLu: x = leaky_re_lu(x); break;
+        case Id::Elu: x = elu(x); break;
+        case Id::Num: break;
+        }
+    }
+}
+
+// The fast kernels take one exp per value, of x scaled by -1 for sigmoid, 2 for tanh and 1
+// for elu. With r = 1 / (1 + e), sigmoid is r and tanh is 1 - 2r, so large inputs settle
+// on exactly 0 and +-1.
+namespace FastActivation
+{
+    static constexpr float sigmoid_scale = -1.0f;
+    static constexpr float tanh_scale = 2.0f;
+    static constexpr float elu_scale = 1.0f;
+}
+
+static float fast_activation(const sf::Uint8 id, const float x)
+{
+    using namespace ActivationFunctions;
+    switch(static_cast<Id>(id))
+    {
+    case Id::Sigmoid: return 1.0f / (1.0f + fast_exp(FastActivation::sigmoid_scale * x));
+    case Id::Tanh: return 1.0f - 2.0f * (1.0f / (1.0f + fast_exp(FastActivation::tanh_scale * x)));
+    case Id::Elu: return x >= 0.0f ? x : alpha * (fast_exp(FastActivation::elu_scale * x) - 1.0f);
+    case Id::BinaryStep: return binary_step(x);
+    case Id::ReLu: return re_lu(x);
+    case Id::LeakyReLu: return leaky_re_lu(x);
+    case Id::Linear:
+    case Id::Num: break;
+    }
+    return x;
+}
+
+static void activate_layer_fast_scalar(const sf::Uint8* ids, float* values, const size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+        values[i] = fast_activation(ids[i], values[i]);
+}
+
+#if SIMD_X86
+SIMD_TARGET_SSE static __m128 fast_exp_sse(__m128 x)
+{
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(FastExp::min_x)), _mm_set1_ps(FastExp::max_x));
+    const __m128 t = _mm_mul_ps(x, _mm_set1_ps(FastExp::log2e));
+    const __m128i n = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(t, _mm_set1_ps(FastExp::round_offset))),
+        _mm_set1_epi32(FastExp::exponent_offset));
+    const __m128 f = _mm_sub_ps(t, _mm_cvtepi32_ps(n));
+    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(FastExp::c5), f), _mm_set1_ps(FastExp::c4));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(FastExp::c3));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(FastExp::c2));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(FastExp::c1));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(FastExp::c0));
+    const __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+    return _mm_mul_ps(p, scale);
+}
+
+SIMD_TARGET_SSE static __m128 select_sse(const __m128 mask, const __m128 a, const __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+SIMD_TARGET_SSE static __m128 is_id_sse(const __m128i ids, const ActivationFunctions::Id id)
+{
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(ids, _mm_set1_epi32(static_cast<int>(id))));
+}
+
+// Every lane computes every candidate and keeps the one its id asks for.
+SIMD_TARGET_SSE static __m128 activate_sse(const __m128i ids, const __m128 x)
+{
+    using ActivationFunctions::Id;
+    const __m128 is_sigmoid = is_id_sse(ids, Id::Sigmoid);
+    const __m128 is_tanh = is_id_sse(ids, Id::Tanh);
+    const __m128 is_elu = is_id_sse(ids, Id::Elu);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 exp_scale = _mm_or_ps(_mm_or_ps(
+        _mm_and_ps(is_sigmoid, _mm_set1_ps(FastActivation::sigmoid_scale)),
+        _mm_and_ps(is_tanh, _mm_set1_ps(FastActivation::tanh_scale))),
+        _mm_and_ps(is_elu, _mm_set1_ps(FastActivation::elu_scale)));
+    const __m128 e = fast_exp_sse(_mm_mul_ps(exp_scale, x));
+    const __m128 r = _mm_div_ps(one, _mm_add_ps(one, e));
+    const __m128 non_negative = _mm_cmpge_ps(x, zero);
+
+    __m128 result = x;
+    result = select_sse(is_id_sse(ids, Id::BinaryStep), _mm_and_ps(non_negative, one), result);
+    result = select_sse(is_sigmoid, r, result);
+    result = select_sse(is_tanh, _mm_sub_ps(one, _mm_mul_ps(_mm_set1_ps(2.0f), r)), result);
+    result = select_sse(is_id_sse(ids, Id::ReLu), _mm_max_ps(x, zero), result);
+    result = select_sse(is_id_sse(ids, Id::LeakyReLu), _mm_max_ps(x, _mm_mul_ps(_mm_set1_ps(0.1f), x)), result);
+    const __m128 elu = select_sse(non_negative, x,
+        _mm_mul_ps(_mm_set1_ps(ActivationFunctions::alpha), _mm_sub_ps(e, one)));
+    return select_sse(is_elu, elu, result);
+}
+
+SIMD_TARGET_SSE static void activate_layer_fast_sse(const sf::Uint8* ids, float* values, const size_t count)
+{
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        int packed_ids;
+        std::memcpy(&packed_ids, ids + i, sizeof(packed_ids));
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i wide_ids = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed_ids), zero), zero);
+        _mm_storeu_ps(values + i, activate_sse(wide_ids, _mm_loadu_ps(values + i)));
+    }
+    for(; i < count; i++)
+        values[i] = fast_activation(ids[i], values[i]);
+}
+
+SIMD_TARGET_AVX2 static __m256 fast_exp_avx2(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(FastExp::min_x)), _mm256_set1_ps(FastExp::max_x));
+    const __m256 t = _mm256_mul_ps(x, _mm256_set1_ps(FastExp::log2e));
+    const __m256i n = _mm256_sub_epi32(_mm256_cvttps_epi32(_mm256_add_ps(t, _mm256_set1_ps(FastExp::round_offset))),
+        _mm256_set1_epi32(FastExp::exponent_offset));
+    const __m256 f = _mm256_sub_ps(t, _mm256_cvtepi32_ps(n));
+    __m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(FastExp::c5), f), _mm256_set1_ps(FastExp::c4));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(FastExp::c3));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(FastExp::c2));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(FastExp::c1));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(FastExp::c0));
+    const __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23));
+    return _mm256_mul_ps(p, scale);
+}
+
+SIMD_TARGET_AVX2 static __m256 is_id_avx2(const __m256i ids, const ActivationFunctions::Id id)
+{
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(ids, _mm256_set1_epi32(static_cast<int>(id))));
+}
+
+SIMD_TARGET_AVX2 static __m256 activate_avx2(const __m256i ids, const __m256 x)
+{
+    using ActivationFunctions::Id;
+    const __m256 is_sigmoid = is_id_avx2(ids, Id::Sigmoid);
+    const __m256 is_tanh = is_id_avx2(ids, Id::Tanh);
+    const __m256 is_elu = is_id_avx2(ids, Id::Elu);
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 exp_scale = _mm256_or_ps(_mm256_or_ps(
+        _mm256_and_ps(is_sigmoid, _mm256_set1_ps(FastActivation::sigmoid_scale)),
+        _mm256_and_ps(is_tanh, _mm256_set1_ps(FastActivation::tanh_scale))),
+        _mm256_and_ps(is_elu, _mm256_set1_ps(FastActivation::elu_scale)));
+    const __m256 e = fast_exp_avx2(_mm256_mul_ps(exp_scale, x));
+    const __m256 r = _mm256_div_ps(one, _mm256_add_ps(one, e));
+    const __m256 non_negative = _mm256_cmp_ps(x, zero, _CMP_GE_OQ);
+
+    __m256 result = x;
+    result = _mm256_blendv_ps(result, _mm256_and_ps(non_negative, one), is_id_avx2(ids, Id::BinaryStep));
+    result = _mm256_blendv_ps(result, r, is_sigmoid);
+    result = _mm256_blendv_ps(result, _mm256_sub_ps(one, _mm256_mul_ps(_mm256_set1_ps(2.0f), r)), is_tanh);
+    result = _mm256_blendv_ps(result, _mm256_max_ps(x, zero), is_id_avx2(ids, Id::ReLu));
+    result = _mm256_blendv_ps(result, _mm256_max_ps(x, _mm256_mul_ps(_mm256_set1_ps(0.1f), x)), is_id_avx2(ids, Id::LeakyReLu));
+    const __m256 elu = _mm256_blendv_ps(
+        _mm256_mul_ps(_mm256_set1_ps(ActivationFunctions::alpha), _mm256_sub_ps(e, one)), x, non_negative);
+    return _mm256_blendv_ps(result, elu, is_elu);
+}
+
+SIMD_TARGET_AVX2 static void activate_layer_fast_avx2(const sf::Uint8* ids, float* values, const size_t count)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        const __m256i wide_ids = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(ids + i)));
+        _mm256_storeu_ps(values + i, activate_avx2(wide_ids, _mm256_loadu_ps(values + i)));
+    }
+    activate_layer_fast_sse(ids + i, values + i, count - i);
+}
+#endif
+
+ActivationFunctions::LayerKernel ActivationFunctions::get_layer_kernel()
+{
+    if(current_mode == Mode::Exact)
+        return activate_layer_exact;
+#if SIMD_X86
+    switch(get_simd_level())
+    {
+    case SimdLevel::Avx2: return activate_layer_fast_avx2;
+    case SimdLevel::Sse: return activate_layer_fast_sse;
+    case SimdLevel::Scalar: break;
+    }
+#endif
+    return activate_layer_fast_scalar;
+}
@@ -0,0 +1,57 @@
+﻿#pragma once
+#include "Common.h"
+
+#include <string>
+
+// Per-neuron activation functions. A layer applies all of its neurons' activations in one
+// kernel call instead of calling through a pointer for every neuron.
+namespace ActivationFunctions
+{
+    constexpr float alpha = 0.1f;
+    float binary_step(const float x);
+    float sign(const float x);
+    float linear(const float x);
+    float sigmoid(const float x);
+    float tanh(const float x);
+    float re_lu(const float x);
+    float leaky_re_lu(const float x);
+    float elu(const float x);
+
+    // The values stored in NeuralLayer::activation_ids and in snapshots, so only ever append.
+    enum class Id : sf::Uint8  // NOLINT(performance-enum-size)
+    {
+        BinaryStep,
+        Linear,
+        Sigmoid,
+        Tanh,
+        ReLu,
+        LeakyReLu,
+        Elu,
+        Num
+    };
+    static constexpr size_t count = static_cast<size_t>(Id::Num);
+
+    float get_complexity(const sf::Uint8 id);
+
+    // Exact calls the standard library's exp and tanh per value. Fast evaluates a whole layer
+    // in SIMD, whatever mix of ids it has, with sigmoid, tanh and elu sharing one polynomial
+    // exp. It stays within these absolute errors of the exact functions for all finite inputs:
+    //   sigmoid 1.2e-7, tanh 2.4e-7, elu 1.8e-8
+    // which is about what rounding to float already costs the exact ones.
+    // Both give the same bits at every SIMD level; only switching modes changes results.
+    enum class Mode : sf::Uint8  // NOLINT(performance-enum-size)
+    {
+        Exact,
+        Fast
+    };
+    // Defaults to Exact. Meant to be picked once at startup, before any thread evaluates.
+    Mode get_mode();
+    void set_mode(const Mode mode);
+    const char* get_mode_name(const Mode mode);
+    bool parse_mode(const std::string& name, Mode& out);
+
+    // Applies each value's own activation in place: values[i] = f[ids[i]](values[i]).
+    typedef void(*LayerKernel)(const sf::Uint8* ids, float* values, const size_t count);
+    // The kernel for the current SIMD level and mode.
+    LayerKernel get_layer_kernel();
+}
@@ -0,0 +1,83 @@
+﻿#pragma once
+#include <SFML/System.hpp>
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Raw little helpers for the snapshot format. Values are stored as their in-memory bytes,
+// so a snapshot is only readable on a machine with the same endianness and type sizes.
+class BinaryWriter
+{
+public:
+    template <typename T>
+    void write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written");
+        append(&value, sizeof(T));
+    }
+
+    // Element count first, then the elements back to back.
+    template <typename T>
+    void write_vector(const std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written");
+        write<sf::Uint64>(values.size());
+        append(values.data(), values.size() * sizeof(T));
+    }
+
+    inline void append(const void* data, const size_t size)
+    {
+        const auto bytes = static_cast<const char*>(data);
+        bytes_.insert(bytes_.end(), bytes, bytes + size);
+    }
+
+    inline std::vector<char>& get_bytes() { return bytes_; }
+
+private:
+    std::vector<char> bytes_;
+};
+
+// Reads what BinaryWriter wrote. Every read checks the remaining size and returns false
+// instead of running past the end, so a truncated or corrupt file cannot crash the loader.
+class BinaryReader
+{
+public:
+    BinaryReader(const void* data, const size_t size)
+        : data_(static_cast<const char*>(data)), remaining_(size) {}
+
+    template <typename T>
+    bool read(T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read");
+        return take(&value, sizeof(T));
+    }
+
+    template <typename T>
+    bool read_vector(std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read");
+        sf::Uint64 count;
+        if(!read(count) || count > remaining_ / sizeof(T))
+            return false;
+        values.resize(static_cast<size_t>(count));
+        return take(values.data(), values.size() * sizeof(T));
+    }
+
+    inline bool take(void* out, const size_t size)
+    {
+        if(size > remaining_)
+            return false;
+        if(size != 0)
+            std::memcpy(out, data_, size);
+        data_ += size;
+        remaining_ -= size;
+        return true;
+    }
+
+    inline size_t get_remaining() const { return remaining_; }
+
+private:
+    const char* data_;
+    size_t remaining_;
+};
@@ -0,0 +1,94 @@
+﻿#include "Chunks.h"
+
+#include <cmath>
+
+void ChunkMap::create(const sf::Vector2f& extent, const float chunk_size)
+{
+    chunk_size_ = chunk_size;
+    columns_ = std::max<size_t>(1, static_cast<size_t>(std::ceil(extent.x / chunk_size_)));
+    rows_ = std::max<size_t>(1, static_cast<size_t>(std::ceil(extent.y / chunk_size_)));
+    awake_.assign(columns_ * rows_, 1);
+    asleep_since_.assign(awake_.size(), 0.0);
+    wanted_.assign(awake_.size(), 0);
+    plants_.assign(awake_.size(), std::vector<sf::Uint32>());
+}
+
+void ChunkMap::clear()
+{
+    columns_ = 0;
+    rows_ = 0;
+    awake_.clear();
+    asleep_since_.clear();
+    wanted_.clear();
+    plants_.clear();
+}
+
+size_t ChunkMap::get_chunk(const sf::Vector2f& position) const
+{
+    return get_row(position.y) * columns_ + get_column(position.x);
+}
+
+void ChunkMap::clear_wanted()
+{
+    wanted_.assign(wanted_.size(), 0);
+}
+
+void ChunkMap::want(const sf::Vector2f& center, const float radius)
+{
+    const size_t column_begin = get_column(center.x - radius);
+    const size_t column_end = get_column(center.x + radius);
+    const size_t row_begin = get_row(center.y - radius);
+    const size_t row_end = get_row(center.y + radius);
+    for(size_t row = row_begin; row <= row_end; row++)
+        for(size_t column = column_begin; column <= column_end; column++)
+            wanted_[row * columns_ + column] = 1;
+}
+
+void ChunkMap::wake(const size_t chunk)
+{
+    awake_[chunk] = 1;
+}
+
+void ChunkMap::put_to_sleep(const size_t chunk, const double time)
+{
+    awake_[chunk] = 0;
+    asleep_since_[chunk] = time;
+}
+
+size_t ChunkMap::get_awake_count() const
+{
+    return static_cast<size_t>(std::count(awake_.begin(), awake_.end(), 1));
+}
+
+void ChunkMap::write(BinaryWriter& out) const
+{
+    out.write(chunk_size_);
+    out.write(static_cast<sf::Uint64>(columns_));
+    out.write(static_cast<sf::Uint64>(rows_));
+    out.write_vector(awake_);
+    out.write_vector(asleep_since_);
+}
+
+bool ChunkMap::read(BinaryReader& in)
+{
+    float chunk_size;
+    sf::Uint64 columns;
+    sf::Uint64 rows;
+    std::vector<sf::Uint8> awake;
+    std::vector<double> asleep_since;
+    if(!in.read(chunk_size) || !in.read(columns) || !in.read(rows) || !in.read_vector(awake) ||
+        !in.read_vector(asleep_since))
+        return false;
+    if(awake.size() != columns * rows || asleep_since.size() != awake.size() ||
+        (!awake.empty() && !(chunk_size > 0.0f)))
+        return false;
+
+    chunk_size_ = chunk_size;
+    columns_ = static_cast<size_t>(columns);
+    rows_ = static_cast<size_t>(rows);
+    awake_ = std::move(awake);
+    asleep_since_ = std::move(asleep_since);
+    wanted_.assign(awake_.size(), 0);
+    plants_.assign(awake_.size(), std::vector<sf::Uint32>());
+    return true;
+}
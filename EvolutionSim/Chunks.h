@@ -0,0 +1,86 @@
+﻿#pragma once
+#include "BinaryIO.h"
+#include "Common.h"
+
+// The world cut into square chunks, so the parts of it nobody is looking at can sleep, see
+// Simulation::set_sleeping_chunks. Holds which plants were born in each chunk, which chunks
+// are awake and since when the others have been asleep. Plants never move, so a plant's chunk
+// is the one it was born in.
+namespace ChunkSettings
+{
+    // Many times a creature's reach, so one creature only ever keeps a few chunks awake.
+    static constexpr float chunk_size = 100.0f;
+}
+
+class ChunkMap
+{
+public:
+    // An empty map has no chunks: the whole world is simply awake.
+    ChunkMap() = default;
+
+    // Covers extent with chunks of chunk_size, all awake and holding no plants yet.
+    void create(const sf::Vector2f& extent, const float chunk_size);
+    void clear();
+    inline bool is_empty() const { return awake_.empty(); }
+
+    inline size_t get_chunk_count() const { return awake_.size(); }
+    size_t get_chunk(const sf::Vector2f& position) const;
+
+    inline const std::vector<sf::Uint32>& get_plants(const size_t chunk) const { return plants_[chunk]; }
+    inline void add_plant(const size_t chunk, const sf::Uint32 slot) { plants_[chunk].push_back(slot); }
+    // Drops the slots pred(slot) is true for from the chunk's plants, keeping the order.
+    template <typename F>
+    void remove_plants_if(const size_t chunk, F&& pred);
+
+    // Which chunks should be awake for the coming tick: clear_wanted, then want every chunk
+    // touching the square of half width radius around each centre that needs one.
+    void clear_wanted();
+    void want(const sf::Vector2f& center, const float radius);
+    inline void want_chunk(const size_t chunk) { wanted_[chunk] = 1; }
+    inline void want_all() { wanted_.assign(wanted_.size(), 1); }
+    inline bool is_wanted(const size_t chunk) const { return wanted_[chunk] != 0; }
+
+    inline bool is_awake(const size_t chunk) const { return awake_[chunk] != 0; }
+    // Simulation time the chunk fell asleep at.
+    inline double get_asleep_since(const size_t chunk) const { return asleep_since_[chunk]; }
+    void wake(const size_t chunk);
+    void put_to_sleep(const size_t chunk, const double time);
+    size_t get_awake_count() const;
+
+    // Only the chunks' state; the plant lists are rebuilt from the plants by whoever reads.
+    void write(BinaryWriter& out) const;
+    bool read(BinaryReader& in);
+
+private:
+    inline size_t get_column(const float x) const;
+    inline size_t get_row(const float y) const;
+
+    float chunk_size_ = 1.0f;
+    size_t columns_ = 0;
+    size_t rows_ = 0;
+    std::vector<sf::Uint8> awake_;
+    std::vector<double> asleep_since_;
+    std::vector<sf::Uint8> wanted_;
+    std::vector<std::vector<sf::Uint32>> plants_;
+};
+
+size_t ChunkMap::get_column(const float x) const
+{
+    if(x <= 0.0f)
+        return 0;
+    return std::min(static_cast<size_t>(x / chunk_size_), columns_ - 1);
+}
+
+size_t ChunkMap::get_row(const float y) const
+{
+    if(y <= 0.0f)
+        return 0;
+    return std::min(static_cast<size_t>(y / chunk_size_), rows_ - 1);
+}
+
+template <typename F>
+void ChunkMap::remove_plants_if(const size_t chunk, F&& pred)
+{
+    auto& plants = plants_[chunk];
+    plants.erase(std::remove_if(plants.begin(), plants.end(), pred), plants.end());
+}
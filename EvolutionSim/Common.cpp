@@ -1,5 +1,4 @@
 ﻿#include "Common.h"
 
 sf::Vector2f world_extent = sf::Vector2f(1600, 900);
-sf::Font global_font;
 float time_speed_modifier = 1.0f;
\ No newline at end of file
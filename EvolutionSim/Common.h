@@ -1,11 +1,13 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <iostream>
-#include <mutex>
-#include <SFML/Graphics.hpp>
+#include <vector>
 #include <SFML/System.hpp>
 
-//#define THREAD_SAFE
+#include "Random.h"
 
 #define PI 3.1415926535897932384626433832795
 #define PI_F 3.1415926535897932384626433832795f
@@ -18,37 +20,34 @@
 
 extern float time_speed_modifier;
 extern sf::Vector2f world_extent;
-extern sf::Font global_font;
 
-#ifndef THREAD_SAFE
-inline
-#endif
-int random()
+// The simulation core only links against sfml-system, so colours are kept as plain bytes
+// and converted to sf::Color by the renderer.
+struct Color
 {
-#ifdef THREAD_SAFE
-	static std::mutex mtx;
-	mtx.lock();
-#endif
-	const auto r = rand();  // NOLINT(concurrency-mt-unsafe)
-#ifdef THREAD_SAFE
-	mtx.unlock();
-#endif
-	return r;
+	sf::Uint8 r = 0;
+	sf::Uint8 g = 0;
+	sf::Uint8 b = 0;
+};
+
+inline int random_int()
+{
+	return static_cast<int>(get_random_engine().next() >> 1);
 }
 
 inline float random_float(const float lo, const float hi)
 {
-	return lo + static_cast <float> (random()) /( static_cast <float> (RAND_MAX/(hi-lo)));
+	return lo + get_random_engine().next_float() * (hi - lo);
 }
 
 inline float random_float(const float hi)
 {
-	return static_cast <float> (random()) / (static_cast <float> (RAND_MAX/hi));
+	return get_random_engine().next_float() * hi;
 }
 
 inline float random_float()
 {
-	return static_cast <float> (random()) / static_cast <float> (RAND_MAX);
+	return get_random_engine().next_float();
 }
 
 inline bool random_chance(const float chance)
@@ -63,7 +62,7 @@ sf::Vector2<T> clamp_vec_size(const sf::Vector2<T>& in, const T size)
 	if(len_squared <= size*size)
 		return in;
 	sf::Vector2<T> out;
-	auto len = sqrt(len_squared);
+	auto len = std::sqrt(len_squared);
 	out.x = in.x / len;
 	out.y = in.y / len;
 	return out;
@@ -72,7 +71,7 @@ sf::Vector2<T> clamp_vec_size(const sf::Vector2<T>& in, const T size)
 template <typename T>
 T vector_length(const sf::Vector2<T>& in)
 {
-	return sqrt(in.x * in.x + in.y * in.y);
+	return std::sqrt(in.x * in.x + in.y * in.y);
 }
 
 template <typename T>
@@ -90,7 +89,7 @@ void print(const T& in)
 template <typename T>
 sf::Vector2<T> normalize(const sf::Vector2<T> v, const sf::Vector2<T> def = sf::Vector2<T>(0.0f, 0.0f))
 {
-	const auto len = sqrt(v.x * v.x + v.y * v.y);
+	const auto len = std::sqrt(v.x * v.x + v.y * v.y);
 	if(len == 0)
 		return def;
 	return v / len;
@@ -127,11 +126,11 @@ T clamp(T value, T min, T max)
 template <typename T>
 T acos_deg(const T x)
 {
-	return acos(x) / PI_F * 180.0f;
+	return std::acos(x) / PI_F * 180.0f;
 }
 
 template <typename T>
 T atan_deg(const T x)
 {
-	return atan(x) / PI_F * 180.0f;
+	return std::atan(x) / PI_F * 180.0f;
 }
\ No newline at end of file
@@ -1,330 +1,733 @@
 ﻿#include "Creature.h"
 
-#include <assert.h>
+#include "Profiler.h"
 
-size_t Creature::creatures_count = 0;
-size_t Plant::plant_count = 0;
+#include <limits>
 
-Thing::Thing()
+static sf::Vector2f random_world_position(const float min_x = 0.0f, const float max_x = world_extent.x)
 {
-    position = sf::Vector2f(random_float(world_extent.x), random_float(world_extent.y));
-    shape_ = nullptr;
+    const float x = min_x + random_float(max_x - min_x);
+    const float y = random_float(world_extent.y);
+    return {x, y};
 }
 
-Thing::~Thing()
+sf::Uint32 PlantStore::spawn(const float min_x, const float max_x)
 {
-    delete shape_;
+    const sf::Uint32 i = slots_.allocate();
+    set_slot_value(position, i, random_world_position(min_x, max_x));
+    set_slot_value(size, i, 0.0f);
+    set_slot_value(gene, i, plant_gene);
+    set_slot_value<sf::Uint8>(alive, i, 1);
+    set_slot_value<sf::Uint8>(crowded, i, 0);
+    return i;
 }
 
-Plant::Plant()
+sf::Uint32 PlantStore::spawn_ghost(const sf::Vector2f& at, const float plant_size, const Gene plant_gene_bits)
 {
-    size = 0.0f;
-    shape_ = new sf::CircleShape(size, DRAW_RESOLUTION);
-    shape_->setPosition(position);
-    shape_->setFillColor(sf::Color::White);
-    shape_->setOutlineColor(color_);
-    shape_->setOutlineThickness(1.0f);
-    
-    plant_count++;
+    const sf::Uint32 i = slots_.allocate();
+    set_slot_value(position, i, at);
+    set_slot_value(size, i, plant_size);
+    set_slot_value(gene, i, plant_gene_bits);
+    set_slot_value<sf::Uint8>(alive, i, 0);
+    set_slot_value<sf::Uint8>(crowded, i, 0);
+    return i;
 }
 
-Plant::~Plant()
+void PlantStore::sense(const size_t i, const SpatialGrid& plant_grid)
 {
-    plant_count--;
+    bool overlapping = false;
+    plant_grid.for_each_in_radius(position[i], size[i] + plant_grid.get_max_size(), [&](const sf::Uint32 other)
+    {
+        if(overlapping || other == i)
+            return;
+        overlapping = vector_length_squared(position[i] - position[other]) < square(size[i] + size[other]);
+    });
+    crowded[i] = overlapping ? 1 : 0;
 }
 
-void Plant::tick(const float dt, std::vector<Thing*>& things_in_world)
+void PlantStore::act(const size_t i, const float dt)
 {
-    if(is_overlapping_plant(things_in_world))
+    if(crowded[i])
     {
-        if(size == 0.0f)
-            alive = false;
+        if(size[i] == 0.0f)
+            alive[i] = 0;
         return;
     }
-    size += plant_growth_rate * dt;
+    size[i] += plant_growth_rate * dt;
 }
 
-void Plant::draw(sf::RenderWindow& window)
+void PlantStore::catch_up(const std::vector<sf::Uint32>& slots, const float seconds, const SpatialGrid& plant_grid,
+    PlantCatchUpScratch& scratch)
 {
-    shape_->setRadius(size);
-    shape_->setOrigin(size / 2, size / 2);
-    shape_->setOutlineThickness(size * -0.25f);
-    window.draw(*shape_);
-}
+    // Sorted, so the outcome doesn't depend on the order the slots came in and finding out
+    // whether a neighbour is one of them is a binary search.
+    auto& sorted = scratch.slots;
+    sorted.assign(slots.begin(), slots.end());
+    std::sort(sorted.begin(), sorted.end());
+    const size_t count = sorted.size();
+    const auto find = [&sorted](const sf::Uint32 slot)
+    {
+        const auto found = std::lower_bound(sorted.begin(), sorted.end(), slot);
+        return found != sorted.end() && *found == slot ? static_cast<size_t>(found - sorted.begin()) : sorted.size();
+    };
 
-Plant* Thing::is_overlapping_plant(const std::vector<Thing*>& things_in_world) const
-{
-    for(Thing* thing : things_in_world)
+    // Every pair that could touch before the time is up, each once. Every plant that grows at
+    // all grows from the start until it is stopped, so its size at any time follows from
+    // start_size and stopped_at.
+    auto& pairs = scratch.pairs;
+    auto& growing = scratch.growing;
+    auto& start_size = scratch.start_size;
+    auto& stopped_at = scratch.stopped_at;
+    auto& first_pair = scratch.first_pair;
+    pairs.clear();
+    growing.resize(count);
+    start_size.resize(count);
+    stopped_at.resize(count);
+    first_pair.assign(count + 1, 0);
+    const float most_growth = plant_growth_rate * seconds;
+    const float never = std::numeric_limits<float>::infinity();
+    for(size_t k = 0; k < count; k++)
+    {
+        const sf::Uint32 i = sorted[k];
+        growing[k] = alive[i] && !crowded[i];
+        start_size[k] = size[i];
+        stopped_at[k] = growing[k] ? seconds : 0.0f;
+        plant_grid.for_each_in_radius(position[i], size[i] + 2.0f * most_growth + plant_grid.get_max_size(),
+            [&](const sf::Uint32 other)
+        {
+            const size_t b = find(other);
+            if(other == i || (b < count && b <= k))
+                return;
+            pairs.push_back({k, b, other, vector_length(position[i] - position[other]), never});
+            first_pair[k + 1]++;
+            if(b < count)
+                first_pair[b + 1]++;
+        });
+    }
+    for(size_t k = 0; k < count; k++)
+        first_pair[k + 1] += first_pair[k];
+    // Filled back to front, which leaves first_pair pointing at each slot's first pair.
+    auto& slot_pairs = scratch.slot_pairs;
+    slot_pairs.resize(first_pair[count]);
+    for(size_t k = 0; k < count; k++)
+        first_pair[k] = first_pair[k + 1];
+    for(size_t p = pairs.size(); p-- > 0;)
+    {
+        slot_pairs[--first_pair[pairs[p].a]] = p;
+        if(pairs[p].b < count)
+            slot_pairs[--first_pair[pairs[p].b]] = p;
+    }
+
+    const auto size_at = [&](const size_t k, const float time)
+    {
+        return start_size[k] + plant_growth_rate * std::min(time, stopped_at[k]);
+    };
+    auto& events = scratch.events;
+    events.clear();
+    const auto later = [](const PlantCatchUpScratch::Event& x, const PlantCatchUpScratch::Event& y)
+    {
+        return x.when > y.when || (x.when == y.when && x.pair > y.pair);
+    };
+    // Works out when the pair touches from now on, and queues it if that's before the time is
+    // up. Events a pair had queued before go stale and are skipped.
+    const auto schedule = [&](const size_t p, const float now)
+    {
+        auto& pair = pairs[p];
+        const int growers = growing[pair.a] + (pair.b < count ? growing[pair.b] : 0);
+        if(growers == 0)
+        {
+            pair.when = never;
+            return;
+        }
+        const float gap = pair.distance - size_at(pair.a, now) - (pair.b < count ? size_at(pair.b, now) : size[pair.other]);
+        pair.when = gap <= 0.0f ? now : now + gap / (plant_growth_rate * static_cast<float>(growers));
+        if(pair.when < seconds)
+        {
+            events.push_back({pair.when, p});
+            std::push_heap(events.begin(), events.end(), later);
+        }
+    };
+    for(size_t p = 0; p < pairs.size(); p++)
+        schedule(p, 0.0f);
+
+    // Whichever pair touches first stops growing, then the next, until the time is up. Only
+    // the pairs of a plant that stopped change when they touch.
+    const auto stop = [&](const size_t k, const float now)
+    {
+        if(!growing[k])
+            return;
+        growing[k] = 0;
+        stopped_at[k] = now;
+        for(size_t n = first_pair[k]; n < first_pair[k + 1]; n++)
+            schedule(slot_pairs[n], now);
+    };
+    while(!events.empty())
     {
-        const auto p = dynamic_cast<Plant*>(thing);
-        
-        if (!p || p == this)
+        std::pop_heap(events.begin(), events.end(), later);
+        const auto event = events.back();
+        events.pop_back();
+        auto& pair = pairs[event.pair];
+        if(pair.when != event.when)
             continue;
-        
-        if (is_overlapping_other(p))
-            return p;
+        pair.when = never;
+        crowded[sorted[pair.a]] = 1;
+        if(pair.b < count)
+            crowded[pair.other] = 1;
+        stop(pair.a, event.when);
+        if(pair.b < count)
+            stop(pair.b, event.when);
     }
-    return nullptr;
+
+    for(size_t k = 0; k < count; k++)
+        size[sorted[k]] = size_at(k, seconds);
+}
+
+void PlantStore::remove_dead()
+{
+    for(size_t i = 0; i < get_capacity(); i++)
+        if(is_used(i) && !alive[i])
+            slots_.release(static_cast<sf::Uint32>(i));
+    slots_.sort_free_slots();
 }
 
-bool Thing::is_overlapping_other(const Thing* other) const
+void PlantStore::write(BinaryWriter& out) const
 {
-    return other && vector_length_squared(position - other->position) < square(size + other->size);
+    slots_.write(out);
+    out.write_vector(position);
+    out.write_vector(size);
+    out.write_vector(gene);
+    out.write_vector(alive);
+    out.write_vector(crowded);
 }
 
-Creature::Creature()
+bool PlantStore::read(BinaryReader& in)
 {
-    creatures_count++;
-    energy_ = energy_storage;
-    neural_network = new NeuralNetwork();
-    calculate_energy_consumptions();
-    gene = static_cast<Gene>(random() % 0xFFFF);
-    color_ = sf::Color(
-        static_cast<sf::Uint8>(random() % 256),
-        static_cast<sf::Uint8>(random() % 256),
-        static_cast<sf::Uint8>(random() % 256));
+    if(!slots_.read(in) ||
+        !in.read_vector(position) ||
+        !in.read_vector(size) ||
+        !in.read_vector(gene) ||
+        !in.read_vector(alive) ||
+        !in.read_vector(crowded))
+        return false;
 
-    setup_shape();
-    reproduction_clock_.restart();
+    const size_t capacity = get_capacity();
+    return position.size() == capacity && size.size() == capacity && gene.size() == capacity &&
+        alive.size() == capacity && crowded.size() == capacity;
 }
 
-Creature::Creature(const Creature& other)
- : Thing(other)
+sf::Uint32 CreatureStore::spawn_random(const double time, const float min_x, const float max_x)
 {
- creatures_count++;
-    
-    neural_network = new NeuralNetwork(*other.neural_network);
-    speed = mutate_property(other.speed);
-    color_ = mutate_color(other.color_);
-    gene = mutate_gene(other.gene);
-    size = mutate_property(other.size);
-    vision_angle = mutate_property(other.vision_angle);
-    strength = mutate_property(other.strength);
-    energy_storage = mutate_property(other.energy_storage);
-    diet = mutate_gene(other.diet);
-    average_offspring_count = mutate_property(other.average_offspring_count);
-    max_offspring_offset = mutate_property(other.max_offspring_offset);
-    age_to_reproduce = mutate_property(other.age_to_reproduce);
-    
-    position = other.position;
-    
-    alive = true;
-    energy_ = energy_storage;
-    calculate_energy_consumptions();
+    const sf::Uint32 i = slots_.allocate();
+    set_slot_value(position, i, random_world_position(min_x, max_x));
+    set_slot_value(brains, i, NeuralNetwork());
+    set_slot_value(gene, i, static_cast<Gene>(random_int() % 0xFFFF));
+    const auto r = static_cast<sf::Uint8>(random_int() % 256);
+    const auto g = static_cast<sf::Uint8>(random_int() % 256);
+    const auto b = static_cast<sf::Uint8>(random_int() % 256);
+    set_slot_value(color, i, Color{r, g, b});
+
+    set_slot_value(size, i, 5.0f);
+    set_slot_value<Gene>(diet, i, 1);
+    set_slot_value(speed, i, 10.0f);
+    set_slot_value(vision_angle, i, 30.0f);
+    set_slot_value(vision_distance, i, default_vision_distance);
+    set_slot_value(strength, i, 1.0f);
+    set_slot_value(energy_storage, i, 20.0f);
+    set_slot_value(average_offspring_count, i, 3.0f);
+    set_slot_value(max_offspring_offset, i, 1.0f);
+    set_slot_value(age_to_reproduce, i, 10.0f);
+
+    set_slot_value(orientation, i, sf::Vector2f());
+    set_slot_value(current_speed, i, sf::Vector2f());
+    set_slot_value(energy, i, energy_storage[i]);
+    set_slot_value(last_reproduction_time, i, time);
+    set_slot_value<sf::Uint8>(alive, i, 1);
+    set_slot_value(attack_target, i, EntityHandle());
+    set_slot_value(nearby_plant, i, EntityHandle());
+    set_slot_value(decision, i, Decision());
+    set_slot_value<sf::Uint8>(has_decision, i, 0);
+    calculate_energy_consumptions(i);
+    calculate_vision_angle_terms(i);
+    return i;
+}
 
-    setup_shape();
-    reproduction_clock_.restart();
+sf::Uint32 CreatureStore::spawn_offspring(const size_t parent, const double time)
+{
+    const sf::Uint32 i = slots_.allocate();
+    // A reused slot keeps its old brain's buffers, so only brand new slots allocate.
+    if(i == brains.size())
+        brains.push_back(NeuralNetwork(brains[parent]));
+    else
+        brains[i].copy_mutated_from(brains[parent]);
+
+    // Inherit everything as is, then change only the traits picked for mutation.
+    set_slot_value(speed, i, speed[parent]);
+    set_slot_value(color, i, color[parent]);
+    set_slot_value(gene, i, gene[parent]);
+    set_slot_value(size, i, size[parent]);
+    set_slot_value(vision_angle, i, vision_angle[parent]);
+    set_slot_value(strength, i, strength[parent]);
+    set_slot_value(energy_storage, i, energy_storage[parent]);
+    set_slot_value(diet, i, diet[parent]);
+    set_slot_value(average_offspring_count, i, average_offspring_count[parent]);
+    set_slot_value(max_offspring_offset, i, max_offspring_offset[parent]);
+    set_slot_value(age_to_reproduce, i, age_to_reproduce[parent]);
+    set_slot_value(vision_distance, i, default_vision_distance);
+    for_each_bernoulli_hit(get_random_engine(), static_cast<size_t>(Trait::Num), trait_mutation_chance,
+        [this, i](const size_t trait){ mutate_trait(i, trait); });
+
+    set_slot_value(position, i, position[parent]);
+    set_slot_value(orientation, i, sf::Vector2f());
+    set_slot_value(current_speed, i, sf::Vector2f());
+    set_slot_value(energy, i, energy_storage[i]);
+    set_slot_value(last_reproduction_time, i, time);
+    set_slot_value<sf::Uint8>(alive, i, 1);
+    set_slot_value(attack_target, i, EntityHandle());
+    set_slot_value(nearby_plant, i, EntityHandle());
+    set_slot_value(decision, i, Decision());
+    set_slot_value<sf::Uint8>(has_decision, i, 0);
+    calculate_energy_consumptions(i);
+    calculate_vision_angle_terms(i);
+    return i;
 }
 
-Creature::~Creature()
+sf::Uint32 CreatureStore::spawn_genome(const CreatureGenome& genome, const double time)
 {
-    creatures_count--;
-    delete neural_network;
+    const sf::Uint32 i = slots_.allocate();
+    // Copying the layers rather than the network, whose copy constructor mutates.
+    set_slot_value(brains, i, NeuralNetwork(genome.brain.layers));
+    set_slot_value(gene, i, genome.gene);
+    set_slot_value(diet, i, genome.diet);
+    set_slot_value(color, i, genome.color);
+    set_slot_value(size, i, genome.size);
+    set_slot_value(speed, i, genome.speed);
+    set_slot_value(vision_angle, i, genome.vision_angle);
+    set_slot_value(vision_distance, i, default_vision_distance);
+    set_slot_value(strength, i, genome.strength);
+    set_slot_value(energy_storage, i, genome.energy_storage);
+    set_slot_value(average_offspring_count, i, genome.average_offspring_count);
+    set_slot_value(max_offspring_offset, i, genome.max_offspring_offset);
+    set_slot_value(age_to_reproduce, i, genome.age_to_reproduce);
+
+    set_slot_value(position, i, random_world_position());
+    set_slot_value(orientation, i, sf::Vector2f());
+    set_slot_value(current_speed, i, sf::Vector2f());
+    set_slot_value(energy, i, energy_storage[i]);
+    set_slot_value(last_reproduction_time, i, time);
+    set_slot_value<sf::Uint8>(alive, i, 1);
+    set_slot_value(attack_target, i, EntityHandle());
+    set_slot_value(nearby_plant, i, EntityHandle());
+    set_slot_value(decision, i, Decision());
+    set_slot_value<sf::Uint8>(has_decision, i, 0);
+    calculate_energy_consumptions(i);
+    calculate_vision_angle_terms(i);
+    return i;
 }
 
-bool Creature::can_eat(const Thing* other) const
+CreatureGenome CreatureStore::get_genome(const size_t i) const
 {
-    return other->gene & diet;
+    return {NeuralNetwork(brains[i].layers), gene[i], diet[i], color[i], size[i], speed[i], vision_angle[i], strength[i],
+        energy_storage[i], average_offspring_count[i], max_offspring_offset[i], age_to_reproduce[i]};
 }
 
-bool Creature::can_be_eaten(const Thing* other) const
+void CreatureStore::remove_dead()
 {
-    auto o = dynamic_cast<const Creature*>(other);
-    if(!o) return false;
-    return o->diet & gene;
+    // Brains stay in their slots so the next birth there can reuse their buffers, but their
+    // weight rows go, or the dead would keep them alive.
+    for(size_t i = 0; i < get_capacity(); i++)
+        if(is_used(i) && !alive[i])
+        {
+            slots_.release(static_cast<sf::Uint32>(i));
+            brains[i].release_weights();
+        }
+    slots_.sort_free_slots();
 }
 
-void Creature::setup_shape()
+// Every per-slot array of the store except the brains and the vision angle terms, in snapshot
+// order: first what changes every tick, then what is fixed at birth.
+#define CREATURE_STATE_ARRAYS(X) \
+    X(position) X(orientation) X(current_speed) X(energy) X(last_reproduction_time) X(alive) \
+    X(attack_target) X(nearby_plant) X(decision) X(has_decision)
+#define CREATURE_TRAIT_ARRAYS(X) \
+    X(size) X(gene) X(diet) X(speed) X(vision_angle) \
+    X(vision_distance) X(strength) X(energy_storage) X(average_offspring_count) \
+    X(max_offspring_offset) X(age_to_reproduce) X(idle_energy_consumption) \
+    X(movement_energy_consumption) X(energy_per_offspring) X(color)
+#define CREATURE_STORE_ARRAYS(X) CREATURE_STATE_ARRAYS(X) CREATURE_TRAIT_ARRAYS(X)
+
+void CreatureStore::write(BinaryWriter& out) const
 {
-    shape_ = new sf::CircleShape(size, DRAW_RESOLUTION);
-    shape_->setFillColor(color_);
-    shape_->setOrigin(size / 2.0f, size / 2.0f);
-    shape_->setOutlineColor(sf::Color::White);
-    shape_->setOutlineThickness(size * -0.25f);
+    slots_.write(out);
+#define WRITE_ARRAY(name) out.write_vector(name);
+    CREATURE_STORE_ARRAYS(WRITE_ARRAY)
+#undef WRITE_ARRAY
+    // Free slots only hold on to their brain's buffers.
+    for(size_t i = 0; i < get_capacity(); i++)
+        if(is_used(i))
+            brains[i].write(out);
+}
 
-    direction_shape_.setSize(sf::Vector2f(size * 4.5f, size * 0.25f));
-    direction_shape_.setFillColor(color_);
-    direction_shape_.setOrigin(direction_shape_.getSize().x / 2.0f, 0.0f);
+bool CreatureStore::read(BinaryReader& in)
+{
+    if(!slots_.read(in))
+        return false;
+    const size_t capacity = get_capacity();
+#define READ_ARRAY(name) if(!in.read_vector(name) || name.size() != capacity) return false;
+    CREATURE_STORE_ARRAYS(READ_ARRAY)
+#undef READ_ARRAY
+    vision_cos_half_angle.resize(capacity);
+    vision_sin_half_angle.resize(capacity);
+    for(size_t i = 0; i < capacity; i++)
+        calculate_vision_angle_terms(i);
+
+    // Snapshots hold every living brain's rows in full; interning shares equal ones again.
+    WeightBlockInterner interner;
+    brains.clear();
+    brains.reserve(capacity);
+    for(size_t i = 0; i < capacity; i++)
+    {
+        brains.emplace_back(std::vector<NeuralLayer>());
+        if(is_used(i) && !brains.back().read(in, interner))
+            return false;
+    }
+    return true;
+}
 
-#if DRAW_DEBUG_DATA
-    debug_text_.setFont(global_font);
-    debug_text_.setString("Creature");
-    debug_text_.setFillColor(sf::Color::Magenta);
-    debug_text_.setOutlineColor(sf::Color::Black);
-    debug_text_.setOutlineThickness(0.25f);
-    debug_text_.setCharacterSize(11);
-#endif
+sf::Uint32 CreatureStore::spawn_copy(const CreatureStore& from, const size_t j)
+{
+    const sf::Uint32 i = slots_.allocate();
+#define COPY_ARRAY(name) set_slot_value(name, i, from.name[j]);
+    CREATURE_STORE_ARRAYS(COPY_ARRAY)
+#undef COPY_ARRAY
+    // Handles only mean something in the store they came from.
+    attack_target[i] = EntityHandle();
+    nearby_plant[i] = EntityHandle();
+    set_slot_value(brains, i, NeuralNetwork(from.brains[j].layers));
+    calculate_vision_angle_terms(i);
+    return i;
 }
 
-void Creature::tick(const float dt, std::vector<Thing*>& things_in_world)
+sf::Uint32 CreatureStore::spawn_ghost(const sf::Vector2f& at, const float creature_size, const Gene creature_gene,
+    const Gene creature_diet)
 {
-    attackable_creature_ = nullptr;
-    nearby_plant_ = nullptr;
-    
-    float params[static_cast<size_t>(OutputNode::Num)];
-    get_neural_network_outputs(params, things_in_world);
+    const sf::Uint32 i = slots_.allocate();
+#define CLEAR_ARRAY(name) set_slot_value(name, i, decltype(name)::value_type());
+    CREATURE_STORE_ARRAYS(CLEAR_ARRAY)
+#undef CLEAR_ARRAY
+    position[i] = at;
+    size[i] = creature_size;
+    gene[i] = creature_gene;
+    diet[i] = creature_diet;
+    alive[i] = 0;
+    // Never evaluated; a reused slot keeps its brain's buffers for the next birth.
+    if(i == brains.size())
+        brains.emplace_back(std::vector<NeuralLayer>());
+    calculate_vision_angle_terms(i);
+    return i;
+}
 
-    const sf::Vector2f current_speed = clamp_vec_size(
-        sf::Vector2f(
-            params[static_cast<size_t>(OutputNode::MoveRight)],
-            params[static_cast<size_t>(OutputNode::MoveUp)]),
-        1.0f) * speed;
-    position += dt * current_speed;
-    position = {clamp(position.x, 0.0f, world_extent.x),
-        clamp(position.y, 0.0f, world_extent.y)};
-
-    if(params[static_cast<size_t>(OutputNode::Reproduce)] > 0.0f)
-        reproduce(things_in_world);
-    
-    if(params[static_cast<size_t>(OutputNode::Attack)] > 0.0f)
-        attempt_attack();
-
-    if(!alive) return;
-    
-    energy_ -= dt * (vector_length(current_speed) * movement_energy_consumption_ + idle_energy_consumption_);
-
-    if(nearby_plant_)
-        if(can_eat(nearby_plant_) && nearby_plant_->alive)
+CreatureMemoryStats CreatureStore::get_memory_stats() const
+{
+    CreatureMemoryStats stats;
+    stats.slots = get_capacity();
+    stats.creatures = get_count();
+    size_t slot_bytes = sizeof(NeuralNetwork);
+#define COUNT_STATE_ARRAY(name) stats.state_bytes += name.capacity() * sizeof(decltype(name)::value_type); \
+    slot_bytes += sizeof(decltype(name)::value_type);
+    CREATURE_STATE_ARRAYS(COUNT_STATE_ARRAY)
+#undef COUNT_STATE_ARRAY
+#define COUNT_TRAIT_ARRAY(name) stats.trait_bytes += name.capacity() * sizeof(decltype(name)::value_type); \
+    slot_bytes += sizeof(decltype(name)::value_type);
+    CREATURE_TRAIT_ARRAYS(COUNT_TRAIT_ARRAY)
+    COUNT_TRAIT_ARRAY(vision_cos_half_angle)
+    COUNT_TRAIT_ARRAY(vision_sin_half_angle)
+#undef COUNT_TRAIT_ARRAY
+
+    // Free slots' brains count as well: their buffers are still held.
+    WeightBlockCounter counter;
+    WeightBlockCounter creature_counter;
+    stats.brain_bytes = brains.capacity() * sizeof(NeuralNetwork);
+    stats.creature_bytes = stats.creatures * slot_bytes;
+    for(size_t i = 0; i < brains.size(); i++)
+    {
+        const size_t structure_bytes = brains[i].get_structure_bytes();
+        stats.brain_bytes += structure_bytes;
+        brains[i].count_weight_blocks(counter);
+        if(is_used(i))
         {
-            auto previous_energy = energy_;
-            energy_ = std::min(energy_ + (plant_energy_per_unit_size * nearby_plant_->size), energy_storage);
-            
-            nearby_plant_->size -= (energy_ - previous_energy) / plant_energy_per_unit_size;
-            if(nearby_plant_->size <= 0.0f)
-                nearby_plant_->alive = false;
+            stats.creature_bytes += structure_bytes;
+            brains[i].count_weight_blocks(creature_counter);
         }
+    }
+    stats.weight_bytes = counter.get_stats().unique_bytes;
+    stats.creature_bytes += creature_counter.get_stats().unique_bytes;
+    return stats;
+}
 
-    orientation_ = normalize(current_speed, {1.0f, 0.0f});
+#undef CREATURE_STORE_ARRAYS
+#undef CREATURE_TRAIT_ARRAYS
+#undef CREATURE_STATE_ARRAYS
 
-    if(energy_ <= 0)
-        alive = false;
+WeightBlockStats CreatureStore::get_brain_memory_stats() const
+{
+    WeightBlockCounter counter;
+    for(size_t i = 0; i < get_capacity(); i++)
+        if(is_used(i))
+            brains[i].count_weight_blocks(counter);
+    return counter.get_stats();
 }
 
-void Creature::draw(sf::RenderWindow& window)
+void CreatureStore::sense(const size_t i, const PlantStore& plants, const SpatialGrid& plant_grid,
+    const SpatialGrid& creature_grid, const FoodField& food, BrainBatch& batch)
 {
-#if DRAW_DEBUG_DATA
-    direction_shape_.setPosition(position);
-    direction_shape_.setRotation(atan2f(-orientation_.y, orientation_.x) / PI_F * 180.0f);
-    window.draw(direction_shape_);
-#endif
-    
-    shape_->setPosition(position);
-    window.draw(*shape_);
-    
-#if DRAW_DEBUG_DATA
-    debug_text_.setPosition(position);
-    debug_text_.setString(sf::String(
-        "Energy: " + std::to_string(energy_) +
-        "\nIs Overlapping Plant: " + (static_cast<bool>(nearby_plant_) ? "True" : "False") +
-        "\nGene: " + std::to_string(gene) +
-        "\nDiet: " + std::to_string(diet)
-    ));
-    window.draw(debug_text_);
-#endif
+    attack_target[i] = EntityHandle();
+    nearby_plant[i] = EntityHandle();
+
+    batch.set_network(i, &brains[i]);
+    get_neural_network_parameters(i, plants, plant_grid, creature_grid, food, batch.get_inputs(i));
 }
 
-template <typename T>
-T Creature::mutate_property(const T& property)
+void CreatureStore::keep_decision(const size_t i, const PlantStore& plants)
 {
-    if(!random_chance(0.01f))
-        return property;
+    const EntityHandle plant = nearby_plant[i];
+    if(plant.is_set() && !(plants.is_current(plant) &&
+        is_overlapping(i, plants.position[plant.index], plants.size[plant.index])))
+        nearby_plant[i] = EntityHandle();
+}
 
+void CreatureStore::act(const size_t i, const float dt, const BrainBatch& batch)
+{
+    if(batch.get_network(i))
+    {
+        std::copy_n(batch.get_outputs(i), decision[i].size(), decision[i].begin());
+        has_decision[i] = 1;
+    }
+    const float* params = decision[i].data();
+
+    current_speed[i] = clamp_vec_size(
+        sf::Vector2f(
+            params[static_cast<size_t>(OutputNode::MoveRight)],
+            params[static_cast<size_t>(OutputNode::MoveUp)]),
+        1.0f) * speed[i];
+    position[i] += dt * current_speed[i];
+    position[i] = {clamp(position[i].x, 0.0f, world_extent.x),
+        clamp(position[i].y, 0.0f, world_extent.y)};
+}
+
+void CreatureStore::interact(const size_t i, const float dt, const double time, PlantStore& plants, FoodField& food)
+{
+    // Killed by someone earlier in slot order.
+    if(!alive[i]) return;
+
+    // Read before reproducing: a birth may grow the arrays and move decision[i].
+    const bool wants_to_reproduce = decision[i][static_cast<size_t>(OutputNode::Reproduce)] > 0.0f;
+    const bool wants_to_attack = decision[i][static_cast<size_t>(OutputNode::Attack)] > 0.0f;
+
+    if(wants_to_reproduce)
+        reproduce(i, time);
+
+    if(wants_to_attack)
+        attempt_attack(i);
+
+    if(!alive[i]) return;
+
+    energy[i] -= dt * (vector_length(current_speed[i]) * movement_energy_consumption[i] + idle_energy_consumption[i]);
+
+    const EntityHandle plant = nearby_plant[i];
+    if(plants.is_current(plant) && plants.alive[plant.index] && (plants.gene[plant.index] & diet[i]))
+    {
+        const float previous_energy = energy[i];
+        energy[i] = std::min(energy[i] + (plant_energy_per_unit_size * plants.size[plant.index]), energy_storage[i]);
+
+        plants.size[plant.index] -= (energy[i] - previous_energy) / plant_energy_per_unit_size;
+        if(plants.size[plant.index] <= 0.0f)
+            plants.alive[plant.index] = 0;
+    }
+
+    // Grazing needs no aim: whatever the cell underfoot holds is eaten, up to a full stomach.
+    if(diet[i] & plant_gene)
+    {
+        const float eaten = food.eat(position[i], (energy_storage[i] - energy[i]) / plant_energy_per_unit_size);
+        energy[i] = std::min(energy[i] + eaten * plant_energy_per_unit_size, energy_storage[i]);
+    }
+
+    orientation[i] = normalize(current_speed[i], {1.0f, 0.0f});
+
+    if(energy[i] <= 0)
+        alive[i] = 0;
+}
+
+template <typename T>
+T CreatureStore::perturb_property(const T& property)
+{
     return static_cast<T>(static_cast<float>(property) * random_float(0.9f, 1.1f));
 }
 
-Gene Creature::mutate_gene(const Gene g)
+void CreatureStore::mutate_trait(const size_t i, const size_t trait)
 {
-    Gene mod = 0;
-    for(size_t i = 0; i < sizeof(gene); i++)
+    const size_t gene_bits = static_cast<size_t>(Trait::GeneBits);
+    const size_t diet_bits = static_cast<size_t>(Trait::DietBits);
+    if(trait >= diet_bits)
     {
-        mod <<= 1;
-        if(!random_chance(0.01f))
-            continue;
-        mod += 1;
+        diet[i] ^= static_cast<Gene>(1u << (trait - diet_bits));
+        return;
+    }
+    if(trait >= gene_bits)
+    {
+        gene[i] ^= static_cast<Gene>(1u << (trait - gene_bits));
+        return;
+    }
+
+    switch(static_cast<Trait>(trait))
+    {
+    case Trait::Speed: speed[i] = perturb_property(speed[i]); break;
+    case Trait::ColorR: color[i].r = perturb_property(color[i].r); break;
+    case Trait::ColorG: color[i].g = perturb_property(color[i].g); break;
+    case Trait::ColorB: color[i].b = perturb_property(color[i].b); break;
+    case Trait::Size: size[i] = perturb_property(size[i]); break;
+    case Trait::VisionAngle: vision_angle[i] = perturb_property(vision_angle[i]); break;
+    case Trait::Strength: strength[i] = perturb_property(strength[i]); break;
+    case Trait::EnergyStorage: energy_storage[i] = perturb_property(energy_storage[i]); break;
+    case Trait::AverageOffspringCount: average_offspring_count[i] = perturb_property(average_offspring_count[i]); break;
+    case Trait::MaxOffspringOffset: max_offspring_offset[i] = perturb_property(max_offspring_offset[i]); break;
+    case Trait::AgeToReproduce: age_to_reproduce[i] = perturb_property(age_to_reproduce[i]); break;
+    default: break;
     }
-    return g ^ mod;
 }
 
-sf::Color Creature::mutate_color(const sf::Color& color)
+void CreatureStore::calculate_energy_consumptions(const size_t i)
 {
-    return {
-        mutate_property(color.r),
-        mutate_property(color.g),
-        mutate_property(color.b)
-    };
+    set_slot_value(idle_energy_consumption, i, energy_storage[i] * 0.01f +
+        vision_distance[i] * 0.015f +
+        vision_angle[i] * 0.001f +
+        strength[i] * 0.01f +
+        size[i] * 0.02f +
+        brains[i].get_complexity_factor());
+    set_slot_value(movement_energy_consumption, i, 0.1f * (size[i] * 0.1f +
+        speed[i] * 0.05f));
+    set_slot_value(energy_per_offspring, i, size[i] * 1.5f);
 }
 
-void Creature::calculate_energy_consumptions()
+void CreatureStore::calculate_vision_angle_terms(const size_t i)
 {
-    idle_energy_consumption_ = energy_storage * 0.01f +
-        vision_distance * 0.015f +
-        vision_angle * 0.001f +
-        strength * 0.01f +
-        size * 0.02f +
-        neural_network->get_complexity_factor();
-    movement_energy_consumption_ = 0.1f * (size * 0.1f +
-        speed * 0.05f);
-    energy_per_offspring_ = size * 1.5f;
+    float cos_half_angle;
+    float sin_half_angle;
+    get_vision_angle_terms(vision_angle[i], cos_half_angle, sin_half_angle);
+    set_slot_value(vision_cos_half_angle, i, cos_half_angle);
+    set_slot_value(vision_sin_half_angle, i, sin_half_angle);
 }
 
-void Creature::get_neural_network_parameters(float* out, const std::vector<Thing*>& things_in_world)
+VisionCone CreatureStore::get_vision_cone(const size_t i) const
 {
-    float closest_pray_s = FLT_MAX;
-    float closest_attacker_s = FLT_MAX;
-    Thing* attacker = nullptr;
-    Thing* pray = nullptr;
-    
-    for(const auto i : things_in_world)
-    {
-        const bool is_pray = can_eat(i);
-        const bool is_predator = can_be_eaten(i);
+    return make_vision_cone(position[i], orientation[i], size[i], vision_distance[i],
+        vision_cos_half_angle[i], vision_sin_half_angle[i]);
+}
 
-        if(is_pray || is_predator)
+void CreatureStore::get_neural_network_parameters(const size_t i, const PlantStore& plants, const SpatialGrid& plant_grid,
+    const SpatialGrid& creature_grid, const FoodField& food, float* out)
+{
+    float closest_pray_distance = VisionSettings::not_seen;
+    float closest_attacker_distance = VisionSettings::not_seen;
+    ThingRef attacker = {ThingKind::Creature, EntityHandle::invalid_index};
+    ThingRef pray = {ThingKind::Creature, EntityHandle::invalid_index};
+    sf::Vector2f attacker_position;
+    sf::Vector2f pray_position;
+    float pray_size = 0.0f;
+
+    struct Candidate
+    {
+        ThingRef thing;
+        bool is_pray;
+        bool is_predator;
+    };
+    const VisionCone cone = get_vision_cone(i);
+    const VisionKernel kernel = get_vision_kernel();
+    VisionBlock<Candidate> block;
+
+    // Keeps the nearest visible prey and attacker, by distance to their edge. Blocks are
+    // flushed in the order candidates come in, so ties go to the first one found.
+    const auto keep_nearest = [&](const Candidate& candidate, const float distance,
+        const sf::Vector2f& other_position, const float other_size)
+    {
+        if(candidate.is_predator && closest_attacker_distance > distance)
         {
-            const float n = vector_length_squared(position - i->position) - i->size;
-
-            if(is_predator && can_see_thing(i) && (closest_attacker_s > n))
-            {
-                closest_attacker_s = n;
-                attacker = i;
-            }
-            if(is_pray && can_see_thing(i) && (closest_pray_s > n))
-            {
-                closest_pray_s = n;
-                pray = i;
-            }
+            closest_attacker_distance = distance;
+            attacker = candidate.thing;
+            attacker_position = other_position;
         }
-    }
+        if(candidate.is_pray && closest_pray_distance > distance)
+        {
+            closest_pray_distance = distance;
+            pray = candidate.thing;
+            pray_position = other_position;
+            pray_size = other_size;
+        }
+    };
+    const auto consider = [&](const ThingRef thing, const sf::Vector2f& other_position, const float other_size,
+        const bool is_pray, const bool is_predator)
+    {
+        if(!is_pray && !is_predator)
+            return;
+        const Candidate candidate = {thing, is_pray, is_predator};
+        if(!block.add(other_position, other_size, candidate))
+        {
+            block.flush(cone, kernel, keep_nearest);
+            block.add(other_position, other_size, candidate);
+        }
+    };
+
+    // Anything the cone accepts is either within vision_distance or overlapping us. Plants
+    // can only ever be prey, so they are skipped outright when our diet rules them out.
+    plant_grid.for_each_in_radius(position[i], std::max(vision_distance[i], size[i] + plant_grid.get_max_size()),
+        [&](const sf::Uint32 plant)
+    {
+        if(plants.gene[plant] & diet[i])
+            consider({ThingKind::Plant, plant}, plants.position[plant], plants.size[plant], true, false);
+    });
+    // Food cells are seen by their centres, and only once there is enough on them to be worth it.
+    if(plant_gene & diet[i])
+        food.for_each_cell_in_radius(position[i], std::max(vision_distance[i], size[i]),
+            FoodFieldSettings::visible_biomass, [&](const size_t cell, const sf::Vector2f& center, float)
+        {
+            consider({ThingKind::FoodCell, static_cast<sf::Uint32>(cell)}, center, 0.0f, true, false);
+        });
+    creature_grid.for_each_in_radius(position[i], std::max(vision_distance[i], size[i] + creature_grid.get_max_size()),
+        [&](const sf::Uint32 other)
+    {
+        if(other == i)
+            return;
+        consider({ThingKind::Creature, other}, position[other], size[other],
+            (gene[other] & diet[i]) != 0, (diet[other] & gene[i]) != 0);
+    });
+    block.flush(cone, kernel, keep_nearest);
 
-    sf::Vector2f distance_to_border = position;
+    const bool has_attacker = attacker.index != EntityHandle::invalid_index;
+    const bool has_pray = pray.index != EntityHandle::invalid_index;
+
+    sf::Vector2f distance_to_border = position[i];
     if(distance_to_border.x > world_extent.x / 2)
-        distance_to_border.x = position.x - world_extent.x;
+        distance_to_border.x = position[i].x - world_extent.x;
     if(distance_to_border.y > world_extent.y / 2)
-        distance_to_border.y = position.y - world_extent.y;
+        distance_to_border.y = position[i].y - world_extent.y;
 
-    if(attacker)
-    {
-        attackable_creature_ = dynamic_cast<Creature*>(attacker);
-    }
-    else if(pray)
-    {
-        attackable_creature_ = dynamic_cast<Creature*>(pray);
-    }
-    nearby_plant_ = is_overlapping_other(pray) ? dynamic_cast<Plant*>(pray) : nullptr;
-    //assert(static_cast<bool>(is_overlapping_plant(things_in_world)) == static_cast<bool>(nearby_plant_));
-    //nearby_plant_ = is_overlapping_plant(things_in_world);
+    if(has_attacker)
+        attack_target[i] = get_handle(attacker.index);
+    else if(has_pray && pray.kind == ThingKind::Creature)
+        attack_target[i] = get_handle(pray.index);
+    if(has_pray && pray.kind == ThingKind::Plant && is_overlapping(i, pray_position, pray_size))
+        nearby_plant[i] = plants.get_handle(pray.index);
+
+    out[static_cast<size_t>(InputNode::CanSeeAttacker)] = has_attacker ? 1.f : 0.f;
+    out[static_cast<size_t>(InputNode::CanSeePray)] = has_pray ? 1.f : 0.f;
 
-    out[static_cast<size_t>(InputNode::CanSeeAttacker)] = attacker ? 1.f : 0.f;
-    out[static_cast<size_t>(InputNode::CanSeePray)] = pray ? 1.f : 0.f;
-    
-    out[static_cast<size_t>(InputNode::NearestAttackerXOffset)] = attacker ? attacker->position.x - position.x : 0;
-    out[static_cast<size_t>(InputNode::NearestAttackerYOffset)] = attacker ? attacker->position.y - position.y : 0;
+    out[static_cast<size_t>(InputNode::NearestAttackerXOffset)] = has_attacker ? attacker_position.x - position[i].x : 0;
+    out[static_cast<size_t>(InputNode::NearestAttackerYOffset)] = has_attacker ? attacker_position.y - position[i].y : 0;
 
-    out[static_cast<size_t>(InputNode::NearestPrayXOffset)] = pray ? pray->position.x - position.x : 0;
-    out[static_cast<size_t>(InputNode::NearestPrayYOffset)] = pray ? pray->position.y - position.y : 0;
+    out[static_cast<size_t>(InputNode::NearestPrayXOffset)] = has_pray ? pray_position.x - position[i].x : 0;
+    out[static_cast<size_t>(InputNode::NearestPrayYOffset)] = has_pray ? pray_position.y - position[i].y : 0;
+
+    out[static_cast<size_t>(InputNode::CurrentEnergy)] = energy[i];
 
-    out[static_cast<size_t>(InputNode::CurrentEnergy)] = energy_;
-    
     //out[static_cast<size_t>(InputNode::RandomA)] = random_float();
     //out[static_cast<size_t>(InputNode::RandomB)] = random_float();
 
@@ -332,79 +735,68 @@ void Creature::get_neural_network_parameters(float* out, const std::vector<Thing
     out[static_cast<size_t>(InputNode::DistanceToNearestBorderY)] = distance_to_border.y;
 }
 
-void Creature::get_neural_network_outputs(float* out, const std::vector<Thing*>& things_in_world)
+void CreatureStore::reproduce(const size_t i, const double time)
 {
-    float params[static_cast<size_t>(InputNode::Num)];
-    get_neural_network_parameters(params, things_in_world);
-
-    neural_network->get_values(params, out);
-}
-
-void Creature::reproduce(std::vector<Thing*>& things_in_world)
-{
-    if(reproduction_clock_.getElapsedTime().asSeconds() < age_to_reproduce / time_speed_modifier)
+    if(time - last_reproduction_time[i] < age_to_reproduce[i])
         return;
     unsigned int offspring_count = static_cast<unsigned int>(std::max(0.0f, random_float(
-        average_offspring_count - max_offspring_offset,
-        average_offspring_count + max_offspring_offset)));
+        average_offspring_count[i] - max_offspring_offset[i],
+        average_offspring_count[i] + max_offspring_offset[i])));
 
-    const float energy_required = energy_per_offspring_ * static_cast<float>(offspring_count);
+    const float energy_required = energy_per_offspring[i] * static_cast<float>(offspring_count);
 
-    if(energy_ < energy_required)
+    if(energy[i] < energy_required)
         return;
 
-    energy_ -= energy_required;
+    energy[i] -= energy_required;
 
-    for(unsigned int i = 0; i < offspring_count; i++)
-        things_in_world.push_back(new Creature(*this));
+    PROFILE_SCOPE("reproduction");
+    PROFILE_COUNTER("births", offspring_count);
+    // Births may grow the arrays, so nothing here holds on to references into them.
+    for(unsigned int n = 0; n < offspring_count; n++)
+        spawn_offspring(i, time);
 
-    reproduction_clock_.restart();
+    last_reproduction_time[i] = time;
 }
 
-void Creature::attempt_attack()
+void CreatureStore::attempt_attack(const size_t i)
 {
-    if(!attackable_creature_ || !alive)
+    const EntityHandle target = attack_target[i];
+    if(!is_current(target) || !alive[i])
         return;
-    if(vector_length_squared(position - attackable_creature_->position) > size || !attackable_creature_->alive)
+    const size_t other = target.index;
+    if(vector_length_squared(position[i] - position[other]) > size[i] || !alive[other])
         return;
-    
-    auto energy_usage = std::min(energy_, strength * size);
-    auto other_energy_usage = std::min(
-        attackable_creature_->energy_,
-        attackable_creature_->strength * attackable_creature_->size);
+
+    auto energy_usage = std::min(energy[i], strength[i] * size[i]);
+    auto other_energy_usage = std::min(energy[other], strength[other] * size[other]);
 
     if(energy_usage == other_energy_usage)  // NOLINT(clang-diagnostic-float-equal)
         return;
 
-    Creature* winner;
-    Creature* loser;
-    
+    PROFILE_SCOPE("attack");
+    PROFILE_COUNTER("kills", 1);
+
+    size_t winner;
+    size_t loser;
+
     if(energy_usage < other_energy_usage)
     {
-        winner = attackable_creature_;
-        loser = this;
+        winner = other;
+        loser = i;
     }
     else
     {
-        winner = this;
-        loser = attackable_creature_;
+        winner = i;
+        loser = other;
     }
 
-    loser->alive = false;
-    winner->energy_ = std::min(winner->energy_storage,
-        winner->energy_ + loser->energy_ - std::min(energy_usage, other_energy_usage));
-    
+    alive[loser] = 0;
+    energy[winner] = std::min(energy_storage[winner],
+        energy[winner] + energy[loser] - std::min(energy_usage, other_energy_usage));
 }
 
-bool Creature::can_see_thing(const Thing* thing) const
+bool CreatureStore::is_overlapping(const size_t i, const sf::Vector2f& other_position, const float other_size) const
 {
-    if(is_overlapping_other(thing))
-        return true;
-    const auto offset = thing->position - position;
-
-    if (vector_length_squared(offset) > vision_distance * vision_distance)
-        return false;
-
-    const auto offset_len = vector_length(offset);
-    return vision_angle >= acos_deg(dot(offset / offset_len, orientation_)) - atan_deg(thing->size / offset_len);
+    return vector_length_squared(position[i] - other_position) < square(size[i] + other_size);
 }
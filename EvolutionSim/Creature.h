@@ -1,107 +1,271 @@
 ﻿#pragma once
 #include "Common.h"
+#include "EntityStore.h"
+#include "FoodField.h"
 #include "NeuralNetwork.h"
+#include "SpatialGrid.h"
+#include "Vision.h"
 
-class NeuralNetwork;
+#include <array>
 
 typedef sf::Uint16 Gene;
-#define DRAW_RESOLUTION 32
 
-#define DRAW_DEBUG_DATA 1 && _DEBUG
+// Plants and creatures are kept structure-of-arrays style: one dense array per field, indexed
+// by slot. Slots of the dead are handed to the next births, which reuse the memory the arrays
+// (and the creature brains) already hold for them.
+//
+// A tick runs three phases over every slot, each finishing before the next starts.
+// sense runs in parallel: it may read the whole world but only write the entity's own slot
+// and its row of the brain batch.
+// act runs in parallel: applies the entity's own decisions without looking at anything else.
+// interact runs serially in slot order, so conflicts over food, fights and births are
+// settled by whoever comes first.
 
-class Plant;
+constexpr float plant_growth_rate = DEBUG_VALUE_SWITCH(10.0f, 0.1f);
+constexpr float plant_energy_per_unit_size = 3.0f;
+// Plants, and the food field's biomass, all have this gene; creatures eat them if their diet
+// has it too.
+constexpr Gene plant_gene = 1;
 
-class Thing
+// What PlantStore::catch_up works in, kept by the caller between calls so waking chunks
+// stops allocating once the buffers have grown.
+struct PlantCatchUpScratch
 {
-public:
-    Thing();
-    virtual ~Thing();
-    Thing(const Thing&) = default;
-    Thing(Thing&&) = default;
-
-    Plant* is_overlapping_plant(const std::vector<Thing*>& things_in_world) const;
-    bool is_overlapping_other(const Thing* other) const;
-
-    
-    Thing& operator=(const Thing&) = default;
-    Thing& operator=(Thing&&) = default;
-    Gene gene = 1;    
-    float size = 5.0f;
-    sf::Vector2f position;
-    bool alive = true;
-    
-protected:
-    sf::CircleShape* shape_;
-    sf::Color color_ = sf::Color::Green;
-    
-public:
-    virtual void tick(const float dt, std::vector<Thing*>& things_in_world) {}
-    virtual void draw(sf::RenderWindow& window) {}
+    // Two plants that could touch; b is the number of slots when the other plant isn't one
+    // of them. when is the time they touch at with the plants growing as they are now, or
+    // infinity if neither grows.
+    struct Pair
+    {
+        size_t a;
+        size_t b;
+        sf::Uint32 other;
+        float distance;
+        float when;
+    };
+    struct Event
+    {
+        float when;
+        size_t pair;
+    };
+
+    std::vector<sf::Uint32> slots;
+    std::vector<Pair> pairs;
+    std::vector<sf::Uint8> growing;
+    std::vector<float> start_size;
+    std::vector<float> stopped_at;
+    // The pairs each slot is in: slot_pairs[first_pair[k]] up to slot_pairs[first_pair[k + 1]].
+    std::vector<size_t> first_pair;
+    std::vector<size_t> slot_pairs;
+    // A min-heap on when, then pair.
+    std::vector<Event> events;
 };
 
-constexpr float plant_growth_rate = DEBUG_VALUE_SWITCH(10.0f, 0.1f);
-constexpr float plant_energy_per_unit_size = 3.0f;
-class Plant : public Thing
+class PlantStore
 {
 public:
-    Plant();
-    ~Plant() override;
-    void tick(const float dt, std::vector<Thing*>& things_in_world) override;
-    void draw(sf::RenderWindow& window) override;
+    // Places a new seedling somewhere in the world, with x between min_x and max_x, and
+    // returns its slot.
+    sf::Uint32 spawn(const float min_x = 0.0f, const float max_x = world_extent.x);
+    // A copy of a plant another shard owns, see Simulation::read_border. It is born dead, so
+    // it can be seen and crowd others but never grows or gets eaten, and remove_dead clears
+    // it at the end of the tick.
+    sf::Uint32 spawn_ghost(const sf::Vector2f& at, const float plant_size, const Gene plant_gene_bits);
+    // plant_grid holds this store's slots.
+    void sense(const size_t i, const SpatialGrid& plant_grid);
+    void act(const size_t i, const float dt);
+    // Brings the plants in slots seconds forward at once, the way sense and act would have
+    // with nothing eating them: each grows at plant_growth_rate until it touches another
+    // plant and is crowded from then on. Plants outside slots stay as they are throughout.
+    // plant_grid holds this store's slots as they are now.
+    void catch_up(const std::vector<sf::Uint32>& slots, const float seconds, const SpatialGrid& plant_grid,
+        PlantCatchUpScratch& scratch);
+    // Frees the slot of every plant that died this tick.
+    void remove_dead();
+
+    void write(BinaryWriter& out) const;
+    bool read(BinaryReader& in);
+
+    inline size_t get_capacity() const { return slots_.get_capacity(); }
+    inline size_t get_count() const { return slots_.get_count(); }
+    inline bool is_used(const size_t i) const { return slots_.is_used(i); }
+    inline EntityHandle get_handle(const size_t i) const { return slots_.get_handle(static_cast<sf::Uint32>(i)); }
+    inline bool is_current(const EntityHandle handle) const { return slots_.is_current(handle); }
+
+    static constexpr Color color = {0, 255, 0};
+
+    std::vector<sf::Vector2f> position;
+    std::vector<float> size;
+    std::vector<Gene> gene;
+    std::vector<sf::Uint8> alive;
+    std::vector<sf::Uint8> crowded;
+
+private:
+    SlotAllocator slots_;
+};
+
+// What a creature passes on: its brain and every trait fixed at birth. Enough to rebuild it
+// in another world.
+struct CreatureGenome
+{
+    NeuralNetwork brain;
+    Gene gene;
+    Gene diet;
+    Color color;
+    float size;
+    float speed;
+    float vision_angle;
+    float strength;
+    float energy_storage;
+    float average_offspring_count;
+    float max_offspring_offset;
+    float age_to_reproduce;
+};
+
+// What a CreatureStore takes in memory, in bytes, counting every slot it has, used or not.
+// Shared weight rows count once.
+struct CreatureMemoryStats
+{
+    size_t slots = 0;
+    size_t creatures = 0;
+    // Per-slot arrays that change every tick, and those fixed at birth.
+    size_t state_bytes = 0;
+    size_t trait_bytes = 0;
+    // The brains without their weights, then the weight rows.
+    size_t brain_bytes = 0;
+    size_t weight_bytes = 0;
+    // What the living creatures alone take: their share of the arrays, their brains and the
+    // weight rows they hold between them.
+    size_t creature_bytes = 0;
 
-    static size_t plant_count;
+    inline size_t get_total_bytes() const { return state_bytes + trait_bytes + brain_bytes + weight_bytes; }
+    // Stays put as the population rises and falls, unlike the total over the living.
+    inline size_t get_bytes_per_slot() const { return slots > 0 ? get_total_bytes() / slots : 0; }
+    inline size_t get_bytes_per_creature() const { return creatures > 0 ? creature_bytes / creatures : 0; }
 };
 
-class Creature : public Thing
+// A brain's outputs, indexed by OutputNode.
+using Decision = std::array<float, static_cast<size_t>(OutputNode::Num)>;
+
+class CreatureStore
 {
 public:
-    Creature();
-    Creature(const Creature &other);
-    ~Creature() override;
-    bool can_eat(const Thing* other) const;
-    bool can_be_eaten(const Thing* other) const;
-    
-    void tick(const float dt, std::vector<Thing*>& things_in_world) override;
-    void draw(sf::RenderWindow& window) override;
+    // A creature with default traits, a random brain and colour, somewhere in the world with x
+    // between min_x and max_x. time is the simulation time of the birth.
+    sf::Uint32 spawn_random(const double time, const float min_x = 0.0f, const float max_x = world_extent.x);
+    // A mutated copy of parent, born where the parent stands.
+    sf::Uint32 spawn_offspring(const size_t parent, const double time);
+    // An unmutated copy of genome, newly born somewhere in the world.
+    sf::Uint32 spawn_genome(const CreatureGenome& genome, const double time);
+    CreatureGenome get_genome(const size_t i) const;
+    // Slot j of from, exactly as it is, except that it targets nothing yet.
+    sf::Uint32 spawn_copy(const CreatureStore& from, const size_t j);
+    // A copy of a creature another shard owns, with only what sensing looks at. Dead from the
+    // start like PlantStore::spawn_ghost, so it never senses, acts or can be attacked.
+    sf::Uint32 spawn_ghost(const sf::Vector2f& at, const float creature_size, const Gene creature_gene,
+        const Gene creature_diet);
+
+    // plant_grid and creature_grid hold the slots of plants and of this store. Food can come
+    // from plants, the food field or both; an empty store or field simply offers none.
+    void sense(const size_t i, const PlantStore& plants, const SpatialGrid& plant_grid,
+        const SpatialGrid& creature_grid, const FoodField& food, BrainBatch& batch);
+    // Instead of sense on a tick the creature doesn't think: it goes on with its last decision
+    // and targets, except a plant it has walked off since.
+    void keep_decision(const size_t i, const PlantStore& plants);
+    // Takes the new decision from batch if the creature thought this tick.
+    void act(const size_t i, const float dt, const BrainBatch& batch);
+    // time is the simulation time at the start of the tick.
+    void interact(const size_t i, const float dt, const double time, PlantStore& plants, FoodField& food);
+    void remove_dead();
+
+    void write(BinaryWriter& out) const;
+    bool read(BinaryReader& in);
+    // How much the living creatures' brains share their weight rows.
+    WeightBlockStats get_brain_memory_stats() const;
+    CreatureMemoryStats get_memory_stats() const;
+
+    inline size_t get_capacity() const { return slots_.get_capacity(); }
+    inline size_t get_count() const { return slots_.get_count(); }
+    inline bool is_used(const size_t i) const { return slots_.is_used(i); }
+    inline EntityHandle get_handle(const size_t i) const { return slots_.get_handle(static_cast<sf::Uint32>(i)); }
+    inline bool is_current(const EntityHandle handle) const { return slots_.is_current(handle); }
 
+    // The change applied to an inherited trait once it has been picked for mutation.
     template <typename T>
-    static T mutate_property(const T& property);
-    static Gene mutate_gene(const Gene g);
-    static sf::Color mutate_color(const sf::Color& color);
-    
-    float speed = 10.0f;
-    float vision_angle = 30.0f;
-    float vision_distance = 10.0f;
-    float strength = 1.0f;
-    float energy_storage = 20.0f;
-    Gene diet = 1;
-    float average_offspring_count = 3.f;
-    float max_offspring_offset = 1.f;
-    float age_to_reproduce = 10.0f;
-    NeuralNetwork* neural_network;
-
-    static size_t creatures_count;
+    static T perturb_property(const T& property);
+
+    // Each inherited trait, and each of the low sizeof(Gene) bits of gene and diet, mutates
+    // independently with this chance at birth.
+    static constexpr float trait_mutation_chance = 0.01f;
+
+    // Also used as the spatial grid cell size, so most sensing queries only touch the 3x3 cells around a creature.
+    static constexpr float default_vision_distance = 10.0f;
+
+    // Updated every tick.
+    std::vector<sf::Vector2f> position;
+    std::vector<sf::Vector2f> orientation;
+    std::vector<sf::Vector2f> current_speed;
+    std::vector<float> energy;
+    // Simulation time of the last litter, or of the creature's own birth.
+    std::vector<double> last_reproduction_time;
+    std::vector<sf::Uint8> alive;
+    std::vector<EntityHandle> attack_target;
+    std::vector<EntityHandle> nearby_plant;
+    // What the brain last decided, acted on every tick until it thinks again. Newborns have
+    // none until their first tick.
+    std::vector<Decision> decision;
+    std::vector<sf::Uint8> has_decision;
+
+    // Fixed at birth.
+    std::vector<float> size;
+    std::vector<Gene> gene;
+    std::vector<Gene> diet;
+    std::vector<float> speed;
+    // Half the cone's width, in degrees either side of the forward direction.
+    std::vector<float> vision_angle;
+    std::vector<float> vision_distance;
+    // Derived from vision_angle; not in snapshots.
+    std::vector<float> vision_cos_half_angle;
+    std::vector<float> vision_sin_half_angle;
+    std::vector<float> strength;
+    std::vector<float> energy_storage;
+    std::vector<float> average_offspring_count;
+    std::vector<float> max_offspring_offset;
+    std::vector<float> age_to_reproduce;
+    std::vector<float> idle_energy_consumption;
+    std::vector<float> movement_energy_consumption;
+    std::vector<float> energy_per_offspring;
+    std::vector<Color> color;
+    std::vector<NeuralNetwork> brains;
+
 private:
-    void calculate_energy_consumptions();
-    void get_neural_network_parameters(float* out, const std::vector<Thing*>& things_in_world);
-    void get_neural_network_outputs(float* out, const std::vector<Thing*>& things_in_world);
-    void reproduce(std::vector<Thing*>& things_in_world);
-    void attempt_attack();
-    bool can_see_thing(const Thing* thing) const;
-    void setup_shape();
-    
-    
-    float energy_;
-    sf::Vector2f orientation_;
-    float idle_energy_consumption_ = 0.1f;
-    float movement_energy_consumption_ = 1.0f;
-    float energy_per_offspring_ = 1.0f;
-    Creature* attackable_creature_ = nullptr;
-    Plant* nearby_plant_ = nullptr;
-    sf::Clock reproduction_clock_;
-    sf::RectangleShape direction_shape_;
-    
-#if DRAW_DEBUG_DATA
-    sf::Text debug_text_;    
-#endif
+    // What for_each_bernoulli_hit picks from at birth; the gene and diet entries are one per bit.
+    enum class Trait : size_t  // NOLINT(performance-enum-size)
+    {
+        Speed,
+        ColorR,
+        ColorG,
+        ColorB,
+        Size,
+        VisionAngle,
+        Strength,
+        EnergyStorage,
+        AverageOffspringCount,
+        MaxOffspringOffset,
+        AgeToReproduce,
+        GeneBits,
+        DietBits = GeneBits + sizeof(Gene),
+        Num = DietBits + sizeof(Gene)
+    };
+
+    void mutate_trait(const size_t i, const size_t trait);
+    void calculate_energy_consumptions(const size_t i);
+    void calculate_vision_angle_terms(const size_t i);
+    VisionCone get_vision_cone(const size_t i) const;
+    void get_neural_network_parameters(const size_t i, const PlantStore& plants, const SpatialGrid& plant_grid,
+        const SpatialGrid& creature_grid, const FoodField& food, float* out);
+    void reproduce(const size_t i, const double time);
+    void attempt_attack(const size_t i);
+    bool is_overlapping(const size_t i, const sf::Vector2f& other_position, const float other_size) const;
+
+    SlotAllocator slots_;
 };
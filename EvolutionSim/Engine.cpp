@@ -1,59 +1,90 @@
 ﻿#include "Engine.h"
 
+#include "Profiler.h"
+
 #include <cassert>
 
 Engine::Engine()
 {
     auto font_loaded = global_font.loadFromFile("arial.ttf");
     assert(font_loaded);
+    // A missing or unreadable snapshot just means starting a fresh world.
+    load_snapshot(simulation_, EngineSettings::snapshot_path);
+    next_autosave_time_ = simulation_.get_time() + EngineSettings::autosave_interval;
     window_manager_ = new WindowManager();
-    time_until_plant_spawn_ = EngineSettings::plant_spawn_interval;
+
+    // The window is created here but drawn to from the render thread, and a context can only
+    // be active on one thread at a time.
+    capture_frame(simulation_, frames_.get_back());
+    frames_.publish();
+    window_manager_->window_->setActive(false);
+    render_thread_ = std::thread(&Engine::render_loop, this);
     clock_.restart();
-    things_.reserve(EngineSettings::initial_plant_count +
-        EngineSettings::initial_creature_count);
-    
-    for(size_t i = 0; i < EngineSettings::initial_plant_count; i++)
-        things_.push_back(new Plant());
+}
 
-    for(size_t i = 0; i < EngineSettings::initial_creature_count; i++)
-        things_.push_back(new Creature());
+Engine::~Engine()
+{
+    rendering_.store(false, std::memory_order_release);
+    render_thread_.join();
+    snapshot_saver_.save(simulation_, EngineSettings::snapshot_path);
+    snapshot_saver_.wait();
+    delete window_manager_;
 }
 
 bool Engine::tick()
 {
-    const auto dt = std::min(1.0f, clock_.restart().asSeconds() * time_speed_modifier);
-    process_events();
-
-    if(Creature::creatures_count == 0)
-        for(size_t i = 0; i < EngineSettings::initial_creature_count; i++)
-            things_.push_back(new Creature());
-
-    time_until_plant_spawn_ -= dt;
+    // Real time only decides how many fixed steps are due; the steps themselves are the same
+    // at any frame rate or speed-up.
+    const size_t steps = simulation_clock_.advance(static_cast<double>(clock_.restart().asSeconds()) * time_speed_modifier);
+    {
+        PROFILE_SCOPE("events");
+        process_events();
+    }
 
-    if(time_until_plant_spawn_ <= 0)
+    if(steps == 0)
     {
-        time_until_plant_spawn_ += EngineSettings::plant_spawn_interval;
-        things_.push_back(new Plant());
+        sf::sleep(sf::milliseconds(EngineSettings::idle_milliseconds));
+        return !close_requested_;
     }
-    
-    for(size_t i = 0; i < things_.size(); i++)
-        things_[i]->tick(dt, things_);
 
-    for(int i = static_cast<int>(things_.size()) - 1; i >= 0; i--)
-        if(!things_[i]->alive)
-            delete remove_at_swap(things_, i);
+    for(size_t i = 0; i < steps; i++)
+        simulation_.tick(simulation_clock_.get_step());
+    if(simulation_.get_time() >= next_autosave_time_)
+    {
+        snapshot_saver_.save(simulation_, EngineSettings::snapshot_path);
+        next_autosave_time_ = simulation_.get_time() + EngineSettings::autosave_interval;
+    }
 
-    window_manager_->draw(things_);
+    {
+        PROFILE_SCOPE("publish frame");
+        capture_frame(simulation_, frames_.get_back());
+        frames_.publish();
+    }
+    PROFILE_FRAME_END();
     
-    return window_manager_->is_window_open();
+    return !close_requested_;
 }
 
 void Engine::process_events()
 {
+    // The window is only closed once the render thread is done with it, in the destructor.
     sf::Event event;
     while (window_manager_->window_->pollEvent(event))
     {
         if (event.type == sf::Event::Closed)
-            window_manager_->window_->close();
+            close_requested_ = true;
+    }
+}
+
+void Engine::render_loop()
+{
+    window_manager_->window_->setActive(true);
+    while(rendering_.load(std::memory_order_acquire))
+    {
+        // With nothing new the last frame is drawn again; vsync keeps that from spinning.
+        frames_.take_latest();
+        PROFILE_SCOPE("draw");
+        window_manager_->draw(frames_.get_front());
     }
+    window_manager_->window_->setActive(false);
 }
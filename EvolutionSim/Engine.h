@@ -1,27 +1,51 @@
 ﻿#pragma once
 #include "Common.h"
+#include "FrameSnapshot.h"
 #include "WindowManager.h"
-#include "Creature.h"
+#include "Simulation.h"
+#include "SimulationClock.h"
+#include "Snapshot.h"
+#include "TripleBuffer.h"
 
+#include <atomic>
+#include <thread>
+
+namespace EngineSettings
+{
+    // The world is resumed from here on start and saved back while running and on exit.
+    static constexpr const char* snapshot_path = "world.snapshot";
+    // Simulated seconds between background saves.
+    static constexpr double autosave_interval = 60.0;
+    // How long tick sleeps when no step is due yet, rather than spinning.
+    static constexpr sf::Int32 idle_milliseconds = 1;
+}
+
+// The simulation runs on the thread calling tick, which also handles the window's events;
+// drawing runs on a render thread of its own. After every tick call that stepped the world,
+// the simulation publishes a FrameSnapshot through a triple buffer, and the render thread
+// draws the newest one it finds, so neither ever waits for the other.
 class Engine
 {
     
 public:
     Engine();
+    ~Engine();
+    // False once the window has been closed.
     bool tick();
     void process_events();
 
 private:
-    std::vector<Thing*> things_;
+    void render_loop();
+
+    Simulation simulation_;
+    SimulationClock simulation_clock_;
+    SnapshotSaver snapshot_saver_;
+    double next_autosave_time_;
     WindowManager* window_manager_;
-    float time_until_plant_spawn_;
     sf::Clock clock_;
-};
+    bool close_requested_ = false;
 
-namespace EngineSettings
-{
-    static constexpr float plant_spawn_interval = 5.f;
-    static constexpr size_t initial_plant_count = 50;
-    
-    static constexpr size_t initial_creature_count = DEBUG_VALUE_SWITCH(100, 1000);
-}
\ No newline at end of file
+    TripleBuffer<FrameSnapshot> frames_;
+    std::atomic<bool> rendering_{true};
+    std::thread render_thread_;
+};
@@ -0,0 +1,129 @@
+﻿#pragma once
+#include "BinaryIO.h"
+#include "Common.h"
+
+#include <functional>
+#include <utility>
+
+// Refers to one entity in a store. The generation changes whenever the slot is freed, so a
+// handle kept past its entity's death stops resolving instead of pointing at the newcomer.
+struct EntityHandle
+{
+    static constexpr sf::Uint32 invalid_index = 0xFFFFFFFF;
+
+    sf::Uint32 index = invalid_index;
+    sf::Uint32 generation = 0;
+
+    inline bool is_set() const { return index != invalid_index; }
+};
+
+enum class ThingKind : sf::Uint8  // NOLINT(performance-enum-size)
+{
+    Plant,
+    Creature,
+    FoodCell
+};
+
+// Slot of a plant or a creature, or a FoodField cell, for state that may refer to any kind,
+// like a creature's nearest prey.
+struct ThingRef
+{
+    ThingKind kind;
+    sf::Uint32 index;
+};
+
+// Slot bookkeeping shared by the entity stores. Dead entities give their slot back and the
+// next birth reuses it, together with whatever memory the store's arrays hold for it.
+class SlotAllocator
+{
+public:
+    // Returns the slot to fill. A slot index equal to the old capacity means the store has to
+    // grow its arrays by one.
+    sf::Uint32 allocate();
+    void release(const sf::Uint32 index);
+    // Call after a batch of releases so the next births fill the lowest free slots first.
+    void sort_free_slots();
+
+    inline bool is_used(const size_t index) const { return used_[index] != 0; }
+    inline EntityHandle get_handle(const sf::Uint32 index) const { return {index, generations_[index]}; }
+    inline bool is_current(const EntityHandle handle) const
+    {
+        return handle.index < generations_.size() &&
+            generations_[handle.index] == handle.generation &&
+            used_[handle.index] != 0;
+    }
+    inline size_t get_capacity() const { return generations_.size(); }
+    inline size_t get_count() const { return count_; }
+
+    void write(BinaryWriter& out) const;
+    bool read(BinaryReader& in);
+
+private:
+    std::vector<sf::Uint32> generations_;
+    std::vector<sf::Uint8> used_;
+    // Highest index first once sorted, so births keep the front of the arrays dense.
+    std::vector<sf::Uint32> free_slots_;
+    size_t count_ = 0;
+};
+
+inline sf::Uint32 SlotAllocator::allocate()
+{
+    count_++;
+    if(!free_slots_.empty())
+    {
+        const sf::Uint32 index = free_slots_.back();
+        free_slots_.pop_back();
+        used_[index] = 1;
+        return index;
+    }
+    generations_.push_back(0);
+    used_.push_back(1);
+    return static_cast<sf::Uint32>(generations_.size() - 1);
+}
+
+inline void SlotAllocator::release(const sf::Uint32 index)
+{
+    count_--;
+    used_[index] = 0;
+    generations_[index]++;
+    free_slots_.push_back(index);
+}
+
+inline void SlotAllocator::sort_free_slots()
+{
+    std::sort(free_slots_.begin(), free_slots_.end(), std::greater<sf::Uint32>());
+}
+
+inline void SlotAllocator::write(BinaryWriter& out) const
+{
+    out.write_vector(generations_);
+    out.write_vector(used_);
+    out.write_vector(free_slots_);
+}
+
+inline bool SlotAllocator::read(BinaryReader& in)
+{
+    if(!in.read_vector(generations_) || !in.read_vector(used_) || !in.read_vector(free_slots_))
+        return false;
+    if(used_.size() != generations_.size())
+        return false;
+
+    count_ = 0;
+    for(const auto used : used_)
+        count_ += used != 0;
+    for(const auto index : free_slots_)
+        if(index >= used_.size() || used_[index] != 0)
+            return false;
+    return count_ + free_slots_.size() == used_.size();
+}
+
+// Writes value into slot index of one of a store's arrays, growing the array when the slot
+// allocator handed out a brand new slot.
+template <typename T>
+void set_slot_value(std::vector<T>& values, const size_t index, T value)
+{
+    if(index == values.size())
+        values.push_back(std::move(value));
+    else
+        values[index] = std::move(value);
+}
@@ -1,7 +1,7 @@
 #include "Common.h"
 #include "Engine.h"
 
-#ifdef _DEBUG
+#if defined(_DEBUG) || !defined(_WIN32)
 int main()
 #else
 int WinMain()
@@ -0,0 +1,547 @@
+﻿#include "Common.h"
+#include "Creature.h"
+#include "FoodField.h"
+#include "Shards.h"
+#include "Simd.h"
+#include "Simulation.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+
+// Seeded benchmarks for the simulation kernels and whole ticks:
+//   EvolutionSimBenchmark [--json PATH] [--seed N] [--threads N] [--simd scalar|sse|avx2] [--activations exact|fast]
+//                         [--food plants|field] [--weights float|int8|validate] [--max-entities N] [--filter TEXT]
+// Every scenario builds its world from the seed, so two runs on the same machine measure the
+// same work. --json writes the results for tracking regressions between releases.
+// --food picks the food model of the whole tick and think rate scenarios. The sparse world
+// scenarios always run plants, and so do the shard ones, with one thread per shard.
+// --weights picks what brains think with in every scenario, see WeightPrecision.
+namespace BenchmarkSettings
+{
+    // Each kernel benchmark repeats until it has run at least this long.
+    static constexpr double min_seconds = 0.25;
+    static constexpr size_t network_count = 256;
+    static constexpr size_t scan_plant_count = 200;
+    static constexpr size_t scan_creature_count = 2000;
+    // Enough that every creature has a dozen or so others in sight range.
+    static constexpr size_t crowded_creature_count = 20000;
+    static constexpr size_t overlap_plant_count = 5000;
+    static constexpr float max_plant_size = 5.0f;
+
+    // Whole ticks: a tenth of the entities are plants, the rest creatures. With the food field
+    // all of them are creatures.
+    static constexpr size_t tick_entity_counts[] = {1000, 10000, 100000};
+    static constexpr size_t warmup_ticks = 2;
+    static constexpr size_t measured_ticks = 20;
+    static constexpr float dt = 1.0f / 60.0f;
+
+    // Whole ticks of the biggest world again, with brains thinking less and less often.
+    static constexpr size_t think_intervals[] = {2, 4, 8};
+
+    // A sparse world as wide as eight default ones: plenty of plants and few creatures,
+    // ticked with every chunk awake and with the quiet ones asleep.
+    static constexpr size_t sparse_world_widths = 8;
+    static constexpr size_t sparse_plant_count = 50000;
+    static constexpr size_t sparse_creature_count = 100;
+
+    // Sharded ticks: a world as wide as eight default ones, with their plants and creatures,
+    // split into more and more processes. Eight shards get a default world each.
+    static constexpr size_t shard_counts[] = {1, 2, 4, 8};
+    static constexpr size_t shard_world_widths = 8;
+    static constexpr size_t shard_ticks = 100;
+}
+
+// Every allocation in the process goes through here, so a benchmark can tell how many
+// allocations its work caused.
+static std::atomic<size_t> allocation_count{0};
+
+void* operator new(const size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if(void* memory = std::malloc(size != 0 ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+// GCC can't tell the free below pairs with the malloc in the replaced operator new.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+struct BenchmarkResult
+{
+    std::string name;
+    // What one operation is: a network evaluation, a creature sensed, a tick...
+    const char* unit;
+    size_t operations;
+    size_t entities;
+    double seconds;
+    size_t allocations;
+    // What the creature store takes per slot when the run ends, for scenarios that have one,
+    // see CreatureMemoryStats::get_bytes_per_slot.
+    size_t bytes_per_creature = 0;
+};
+
+static std::vector<BenchmarkResult> results;
+static std::string filter;
+
+static bool is_selected(const char* name)
+{
+    return filter.empty() || std::strstr(name, filter.c_str()) != nullptr;
+}
+
+static double seconds_since(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static size_t get_bytes_per_slot(const Simulation& simulation)
+{
+    return simulation.get_creatures().get_memory_stats().get_bytes_per_slot();
+}
+
+static void print_result(const BenchmarkResult& result)
+{
+    const double operations = static_cast<double>(result.operations);
+    std::cout << result.name << ": "
+        << result.seconds * 1e9 / operations << " ns/" << result.unit << ", "
+        << operations / result.seconds << " " << result.unit << "s/s, "
+        << static_cast<double>(result.allocations) / operations << " allocations/" << result.unit;
+    if(result.entities != 0)
+        std::cout << ", " << static_cast<double>(result.entities) * operations / result.seconds << " entities/s";
+    if(result.bytes_per_creature != 0)
+        std::cout << ", " << result.bytes_per_creature << " bytes/creature slot";
+    std::cout << std::endl;
+}
+
+// Calls batch until min_seconds have passed; batch returns how many operations it did.
+template <typename F>
+static void run_kernel(const char* name, const char* unit, F&& batch)
+{
+    if(!is_selected(name))
+        return;
+
+    batch();
+    const size_t allocations_before = allocation_count.load();
+    const auto start = std::chrono::steady_clock::now();
+    size_t operations = 0;
+    double seconds = 0.0;
+    do
+    {
+        operations += batch();
+        seconds = seconds_since(start);
+    } while(seconds < BenchmarkSettings::min_seconds);
+
+    results.push_back({name, unit, operations, 0, seconds, allocation_count.load() - allocations_before});
+    print_result(results.back());
+}
+
+static void benchmark_networks(const unsigned int seed)
+{
+    RandomEngine random(seed, 1);
+    RandomEngineScope random_scope(random);
+
+    std::vector<NeuralNetwork> networks;
+    std::vector<NeuralNetwork> children;
+    for(size_t i = 0; i < BenchmarkSettings::network_count; i++)
+    {
+        networks.emplace_back();
+        children.emplace_back();
+    }
+
+    const size_t input_size = static_cast<size_t>(InputNode::Num);
+    const size_t output_size = static_cast<size_t>(OutputNode::Num);
+    std::vector<float> inputs(BenchmarkSettings::network_count * input_size);
+    std::vector<float> outputs(BenchmarkSettings::network_count * output_size);
+    random.fill_uniform(inputs.data(), inputs.size(), -10.0f, 10.0f);
+
+    run_kernel("nn_get_values", "network", [&]
+    {
+        for(size_t i = 0; i < networks.size(); i++)
+            networks[i].get_values(inputs.data() + i * input_size, outputs.data() + i * output_size);
+        return networks.size();
+    });
+
+    // Only the networks made under --weights int8 or validate have an int8 copy to think with.
+    if(get_weight_precision() != WeightPrecision::Float)
+        run_kernel("nn_get_quantised_values", "network", [&]
+        {
+            for(size_t i = 0; i < networks.size(); i++)
+                networks[i].get_quantised_values(inputs.data() + i * input_size, outputs.data() + i * output_size);
+            return networks.size();
+        });
+
+    std::vector<const NeuralNetwork*> network_pointers;
+    for(const auto& network : networks)
+        network_pointers.push_back(&network);
+    run_kernel("nn_get_values_batch", "network", [&]
+    {
+        NeuralNetwork::get_values_batch(network_pointers.data(), network_pointers.size(), inputs.data(), outputs.data());
+        return network_pointers.size();
+    });
+
+    // Births into reused slots.
+    run_kernel("nn_copy_mutated_from", "network", [&]
+    {
+        for(size_t i = 0; i < networks.size(); i++)
+            children[i].copy_mutated_from(networks[i]);
+        return networks.size();
+    });
+
+    // Births into new slots.
+    run_kernel("nn_copy_construct", "network", [&]
+    {
+        for(const auto& network : networks)
+            NeuralNetwork child(network);
+        return networks.size();
+    });
+}
+
+static void benchmark_sensing(const unsigned int seed)
+{
+    RandomEngine random(seed, 2);
+    RandomEngineScope random_scope(random);
+
+    PlantStore plants;
+    CreatureStore creatures;
+    for(size_t i = 0; i < BenchmarkSettings::scan_plant_count; i++)
+        plants.size[plants.spawn()] = random_float(BenchmarkSettings::max_plant_size);
+    for(size_t i = 0; i < BenchmarkSettings::scan_creature_count; i++)
+        creatures.spawn_random(0.0);
+
+    SpatialGrid plant_grid;
+    SpatialGrid creature_grid;
+    plant_grid.rebuild(plants, CreatureStore::default_vision_distance);
+    creature_grid.rebuild(creatures, CreatureStore::default_vision_distance);
+    const FoodField no_food;
+    BrainBatch brains;
+    brains.reset(creatures.get_capacity());
+
+    // The nearest prey and attacker scan, including every vision check it makes.
+    run_kernel("creature_sense", "creature", [&]
+    {
+        for(size_t i = 0; i < creatures.get_capacity(); i++)
+            creatures.sense(i, plants, plant_grid, creature_grid, no_food, brains);
+        return creatures.get_capacity();
+    });
+
+    CreatureStore crowded_creatures;
+    for(size_t i = 0; i < BenchmarkSettings::crowded_creature_count; i++)
+    {
+        const sf::Uint32 creature = crowded_creatures.spawn_random(0.0);
+        const float angle = random_float(2.0f * PI_F);
+        crowded_creatures.orientation[creature] = {std::cos(angle), std::sin(angle)};
+    }
+    SpatialGrid crowded_creature_grid;
+    crowded_creature_grid.rebuild(crowded_creatures, CreatureStore::default_vision_distance);
+    brains.reset(crowded_creatures.get_capacity());
+
+    // Mostly vision checks: every creature has plenty of others around, facing every way.
+    run_kernel("creature_sense_crowded", "creature", [&]
+    {
+        for(size_t i = 0; i < crowded_creatures.get_capacity(); i++)
+            crowded_creatures.sense(i, plants, plant_grid, crowded_creature_grid, no_food, brains);
+        return crowded_creatures.get_capacity();
+    });
+
+    PlantStore crowded_plants;
+    for(size_t i = 0; i < BenchmarkSettings::overlap_plant_count; i++)
+        crowded_plants.size[crowded_plants.spawn()] = random_float(BenchmarkSettings::max_plant_size);
+    SpatialGrid crowded_grid;
+    crowded_grid.rebuild(crowded_plants, CreatureStore::default_vision_distance);
+
+    run_kernel("plant_overlap", "plant", [&]
+    {
+        for(size_t i = 0; i < crowded_plants.get_capacity(); i++)
+            crowded_plants.sense(i, crowded_grid);
+        return crowded_plants.get_capacity();
+    });
+}
+
+static void benchmark_food(const unsigned int seed)
+{
+    RandomEngine random(seed, 3);
+    RandomEngineScope random_scope(random);
+
+    FoodField field;
+    field.create(world_extent, FoodFieldSettings::cell_size, SimulationSettings::initial_food_fill);
+    JobPool jobs(1);
+
+    // One stencil pass over the whole field, on one thread.
+    run_kernel("food_field_grow", "cell", [&]
+    {
+        field.grow(BenchmarkSettings::dt, jobs);
+        return field.get_cell_count();
+    });
+}
+
+static void benchmark_ticks(const unsigned int seed, const size_t thread_count, const size_t max_entities,
+    const FoodModel food_model)
+{
+    for(const size_t entities : BenchmarkSettings::tick_entity_counts)
+    {
+        const std::string name = "tick_" + std::to_string(entities);
+        if(entities > max_entities || !is_selected(name.c_str()))
+            continue;
+
+        const size_t plant_count = food_model == FoodModel::Plants ? entities / 10 : 0;
+        Simulation simulation(seed, thread_count, plant_count, entities - plant_count, food_model);
+        for(size_t i = 0; i < BenchmarkSettings::warmup_ticks; i++)
+            simulation.tick(BenchmarkSettings::dt);
+
+        const size_t allocations_before = allocation_count.load();
+        const auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < BenchmarkSettings::measured_ticks; i++)
+            simulation.tick(BenchmarkSettings::dt);
+        const double seconds = seconds_since(start);
+
+        results.push_back({name, "tick", BenchmarkSettings::measured_ticks, entities, seconds,
+            allocation_count.load() - allocations_before, get_bytes_per_slot(simulation)});
+        print_result(results.back());
+    }
+}
+
+static void benchmark_think_rate(const unsigned int seed, const size_t thread_count, const size_t max_entities,
+    const FoodModel food_model)
+{
+    const size_t entities = std::end(BenchmarkSettings::tick_entity_counts)[-1];
+    if(entities > max_entities)
+        return;
+    for(const size_t think_interval : BenchmarkSettings::think_intervals)
+    {
+        const std::string name = "think_every_" + std::to_string(think_interval);
+        if(!is_selected(name.c_str()))
+            continue;
+
+        const size_t plant_count = food_model == FoodModel::Plants ? entities / 10 : 0;
+        Simulation simulation(seed, thread_count, plant_count, entities - plant_count, food_model);
+        simulation.set_think_rate(think_interval);
+        for(size_t i = 0; i < BenchmarkSettings::warmup_ticks; i++)
+            simulation.tick(BenchmarkSettings::dt);
+
+        const size_t allocations_before = allocation_count.load();
+        const auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < BenchmarkSettings::measured_ticks; i++)
+            simulation.tick(BenchmarkSettings::dt);
+        const double seconds = seconds_since(start);
+
+        results.push_back({name, "tick", BenchmarkSettings::measured_ticks, entities, seconds,
+            allocation_count.load() - allocations_before, get_bytes_per_slot(simulation)});
+        print_result(results.back());
+    }
+}
+
+static void benchmark_sleeping_chunks(const unsigned int seed, const size_t thread_count, const size_t max_entities)
+{
+    const size_t entities = BenchmarkSettings::sparse_plant_count + BenchmarkSettings::sparse_creature_count;
+    if(entities > max_entities)
+        return;
+
+    const sf::Vector2f default_extent = world_extent;
+    world_extent.x *= static_cast<float>(BenchmarkSettings::sparse_world_widths);
+    for(const bool sleeping : {false, true})
+    {
+        const std::string name = sleeping ? "sparse_sleeping" : "sparse_awake";
+        if(!is_selected(name.c_str()))
+            continue;
+
+        Simulation simulation(seed, thread_count, BenchmarkSettings::sparse_plant_count,
+            BenchmarkSettings::sparse_creature_count);
+        simulation.set_sleeping_chunks(sleeping);
+        for(size_t i = 0; i < BenchmarkSettings::warmup_ticks; i++)
+            simulation.tick(BenchmarkSettings::dt);
+
+        const size_t allocations_before = allocation_count.load();
+        const auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < BenchmarkSettings::measured_ticks; i++)
+            simulation.tick(BenchmarkSettings::dt);
+        const double seconds = seconds_since(start);
+
+        results.push_back({name, "tick", BenchmarkSettings::measured_ticks, entities, seconds,
+            allocation_count.load() - allocations_before, get_bytes_per_slot(simulation)});
+        print_result(results.back());
+    }
+    world_extent = default_extent;
+}
+
+static void benchmark_shards(const unsigned int seed, const size_t max_entities)
+{
+    const size_t plant_count = SimulationSettings::initial_plant_count * BenchmarkSettings::shard_world_widths;
+    const size_t creature_count = SimulationSettings::initial_creature_count * BenchmarkSettings::shard_world_widths;
+    if(plant_count + creature_count > max_entities)
+        return;
+
+    const sf::Vector2f default_extent = world_extent;
+    world_extent.x *= static_cast<float>(BenchmarkSettings::shard_world_widths);
+    for(const size_t shard_count : BenchmarkSettings::shard_counts)
+    {
+        const std::string name = "shards_" + std::to_string(shard_count);
+        if(!is_selected(name.c_str()))
+            continue;
+
+        ShardRunner runner(shard_count, seed, 1, plant_count, creature_count);
+        if(!runner.run(BenchmarkSettings::shard_ticks, BenchmarkSettings::dt))
+        {
+            std::cerr << name << " failed" << std::endl;
+            continue;
+        }
+        // The shards tick in lock step, so the slowest one's loop is the run's. They allocate
+        // in processes of their own, where nothing counts it.
+        double seconds = 0.0;
+        for(size_t k = 0; k < shard_count; k++)
+            seconds = std::max(seconds, runner.get_report(k).seconds);
+        results.push_back({name, "tick", BenchmarkSettings::shard_ticks, plant_count + creature_count, seconds, 0});
+        print_result(results.back());
+    }
+    world_extent = default_extent;
+}
+
+static bool write_json(const std::string& path, const unsigned int seed, const size_t thread_count,
+    const FoodModel food_model)
+{
+    std::ofstream file(path);
+    if(!file)
+        return false;
+
+    file << "{\n  \"seed\": " << seed
+        << ",\n  \"threads\": " << thread_count
+        << ",\n  \"simd\": \"" << get_simd_level_name(get_simd_level()) << "\""
+        << ",\n  \"activations\": \"" << ActivationFunctions::get_mode_name(ActivationFunctions::get_mode()) << "\""
+        << ",\n  \"weights\": \"" << get_weight_precision_name(get_weight_precision()) << "\""
+        << ",\n  \"food\": \"" << get_food_model_name(food_model) << "\""
+        << ",\n  \"benchmarks\": [";
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const auto& result = results[i];
+        const double operations = static_cast<double>(result.operations);
+        file << (i == 0 ? "\n" : ",\n")
+            << "    {\"name\": \"" << result.name << "\""
+            << ", \"unit\": \"" << result.unit << "\""
+            << ", \"operations\": " << result.operations
+            << ", \"seconds\": " << result.seconds
+            << ", \"ns_per_op\": " << result.seconds * 1e9 / operations
+            << ", \"ops_per_second\": " << operations / result.seconds
+            << ", \"allocations_per_op\": " << static_cast<double>(result.allocations) / operations
+            << ", \"entities\": " << result.entities
+            << ", \"entities_per_second\": " << static_cast<double>(result.entities) * operations / result.seconds
+            << ", \"bytes_per_creature\": " << result.bytes_per_creature
+            << "}";
+    }
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+static void print_usage()
+{
+    print("usage: EvolutionSimBenchmark [--json PATH] [--seed N] [--threads N] [--simd scalar|sse|avx2] [--activations exact|fast]\n"
+        "                             [--food plants|field] [--weights float|int8|validate] [--max-entities N] [--filter TEXT]");
+}
+
+int main(int argc, char** argv)
+{
+    std::string json_path;
+    unsigned int seed = SimulationSettings::default_seed;
+    size_t thread_count = 0;
+    size_t max_entities = static_cast<size_t>(-1);
+    FoodModel food_model = FoodModel::Plants;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+        if(has_value && std::strcmp(argv[i], "--json") == 0)
+            json_path = argv[++i];
+        else if(has_value && std::strcmp(argv[i], "--seed") == 0)
+            seed = static_cast<unsigned int>(std::stoul(argv[++i]));
+        else if(has_value && std::strcmp(argv[i], "--threads") == 0)
+            thread_count = std::stoul(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--max-entities") == 0)
+            max_entities = std::stoul(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--filter") == 0)
+            filter = argv[++i];
+        else if(has_value && std::strcmp(argv[i], "--activations") == 0)
+        {
+            ActivationFunctions::Mode mode;
+            if(!ActivationFunctions::parse_mode(argv[++i], mode))
+            {
+                print_usage();
+                return 1;
+            }
+            ActivationFunctions::set_mode(mode);
+        }
+        else if(has_value && std::strcmp(argv[i], "--weights") == 0)
+        {
+            WeightPrecision precision;
+            if(!parse_weight_precision(argv[++i], precision))
+            {
+                print_usage();
+                return 1;
+            }
+            set_weight_precision(precision);
+        }
+        else if(has_value && std::strcmp(argv[i], "--food") == 0)
+        {
+            if(!parse_food_model(argv[++i], food_model))
+            {
+                print_usage();
+                return 1;
+            }
+        }
+        else if(has_value && std::strcmp(argv[i], "--simd") == 0)
+        {
+            SimdLevel level;
+            if(!parse_simd_level(argv[++i], level))
+            {
+                print_usage();
+                return 1;
+            }
+            set_simd_level(level);
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    // Resolve 0 the same way the simulation's JobPool does, so the report shows real numbers.
+    const size_t used_threads = JobPool(thread_count).get_thread_count();
+    std::cout << "seed: " << seed
+        << ", threads: " << used_threads
+        << ", simd: " << get_simd_level_name(get_simd_level())
+        << ", activations: " << ActivationFunctions::get_mode_name(ActivationFunctions::get_mode())
+        << ", weights: " << get_weight_precision_name(get_weight_precision())
+        << ", food: " << get_food_model_name(food_model) << std::endl;
+
+    benchmark_networks(seed);
+    benchmark_sensing(seed);
+    benchmark_food(seed);
+    benchmark_ticks(seed, thread_count, max_entities, food_model);
+    benchmark_think_rate(seed, thread_count, max_entities, food_model);
+    benchmark_sleeping_chunks(seed, thread_count, max_entities);
+    benchmark_shards(seed, max_entities);
+
+    if(!json_path.empty() && !write_json(json_path, seed, used_threads, food_model))
+    {
+        std::cerr << "could not write " << json_path << std::endl;
+        return 1;
+    }
+    return 0;
+}
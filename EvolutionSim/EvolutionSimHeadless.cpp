@@ -0,0 +1,399 @@
+﻿#include "Common.h"
+#include "Islands.h"
+#include "Profiler.h"
+#include "Shards.h"
+#include "Simd.h"
+#include "Simulation.h"
+#include "Snapshot.h"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+
+// Runs the simulation without a window as fast as the CPU allows:
+//   EvolutionSimHeadless [--ticks N] [--dt SECONDS] [--report-every N]
+//                       [--seed N] [--threads N] [--simd scalar|sse|avx2] [--activations exact|fast]
+//                       [--food plants|field] [--load PATH] [--save PATH] [--save-every N] [--trace PATH]
+//                       [--islands N] [--migrate-every N] [--migrants N] [--shards N]
+//                       [--think-every N] [--think-budget N] [--sleep-chunks]
+//                       [--weights float|int8|validate]
+// --load resumes from a snapshot instead of a fresh world. --save writes one when the run
+// ends and, with --save-every, in the background every N ticks along the way.
+// --activations fast swaps exp and tanh for approximations, see ActivationFunctions::Mode.
+// --food picks the FoodModel of a fresh world; a loaded one keeps the model it was saved with.
+// --trace writes a Chrome trace of the run; it needs a build with PROFILER_ENABLED, which
+// also adds a per-phase summary to every progress report.
+// --islands runs that many worlds at once with seeds from --seed up, see IslandRunner; every
+// island ticks --ticks times on its own thread, --threads is per island and defaults to 1,
+// and progress is reported by wall time instead. --migrate-every 0 keeps the islands apart.
+// Snapshots and sleeping chunks aren't supported with islands.
+// --shards splits one world into that many processes, see ShardRunner; there are never more
+// strips than fit at the halo's width. --threads is per shard and defaults to 1. It needs plant food and reports once at the end; no snapshots or traces.
+// --think-every and --think-budget set how often brains are evaluated, see
+// Simulation::set_think_rate. A resumed run has to be given the same ones to carry on the same
+// way. Shards always think every tick.
+// --sleep-chunks lets the parts of the world away from every creature sleep, see
+// Simulation::set_sleeping_chunks; like the think rate, a resumed run needs it again. Only a
+// single world with plant food sleeps.
+// --weights int8 makes brains think with 8 bit weights, and validate compares them against the
+// float ones along the way, see WeightPrecision. A resumed run needs it again too.
+namespace HeadlessSettings
+{
+    static constexpr size_t default_ticks = 10000;
+    static constexpr float default_dt = 1.0f / 60.0f;
+    static constexpr size_t default_report_every = 1000;
+    static constexpr double island_report_seconds = 1.0;
+}
+
+static void print_usage()
+{
+    print("usage: EvolutionSimHeadless [--ticks N] [--dt SECONDS] [--report-every N]\n"
+        "                            [--seed N] [--threads N] [--simd scalar|sse|avx2] [--activations exact|fast]\n"
+        "                            [--food plants|field] [--load PATH] [--save PATH] [--save-every N] [--trace PATH]\n"
+        "                            [--islands N] [--migrate-every N] [--migrants N] [--shards N]\n"
+        "                            [--think-every N] [--think-budget N] [--sleep-chunks]\n"
+        "                            [--weights float|int8|validate]");
+}
+
+static void report(const Simulation& simulation, const char* label, const size_t tick, const double seconds, const size_t ticks_in_window)
+{
+    const double ticks_per_second = seconds > 0.0 ? static_cast<double>(ticks_in_window) / seconds : 0.0;
+    std::cout << label << " tick " << tick << ": "
+        << ticks_per_second << " ticks/s, "
+        << simulation.get_creatures().get_count() << " creatures, ";
+    if(simulation.get_food_model() == FoodModel::Field)
+        std::cout << simulation.get_food_field().get_total_biomass() << " food";
+    else
+        std::cout << simulation.get_plants().get_count() << " plants";
+    const auto brains = simulation.get_creatures().get_brain_memory_stats();
+    std::cout << ", brain rows: " << brains.unique_blocks << " unique of " << brains.logical_blocks
+        << " (" << static_cast<double>(brains.unique_bytes) / (1024.0 * 1024.0) << " of "
+        << static_cast<double>(brains.logical_bytes) / (1024.0 * 1024.0) << " MB)";
+    if(get_weight_precision() == WeightPrecision::Validate)
+    {
+        const auto& divergence = simulation.get_brain_divergence();
+        std::cout << ", int8 relative error: " << divergence.get_mean_relative_error() << " mean, "
+            << divergence.max_relative_error << " max, " << divergence.flips << " flipped decisions ("
+            << divergence.get_flip_rate() * 100.0 << "%) in " << divergence.networks << " brains";
+    }
+    const ChunkMap& chunks = simulation.get_chunks();
+    if(!chunks.is_empty())
+        std::cout << ", awake chunks: " << chunks.get_awake_count() << " of " << chunks.get_chunk_count();
+    const auto memory = simulation.get_creatures().get_memory_stats();
+    std::cout << ", creature memory: " << memory.get_bytes_per_slot() << " bytes per slot, "
+        << memory.get_bytes_per_creature() << " per living creature, "
+        << static_cast<double>(memory.get_total_bytes()) / (1024.0 * 1024.0) << " MB in " << memory.slots
+        << " slots" << std::endl;
+}
+
+static int run_islands(IslandRunner& runner, const size_t ticks, const float dt, const std::string& trace_path)
+{
+    using clock = std::chrono::steady_clock;
+    const auto seconds_since = [](const clock::time_point start)
+    {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    };
+
+#if PROFILER_ENABLED
+    Profiler::get().set_tracing(!trace_path.empty());
+#else
+    if(!trace_path.empty())
+        std::cerr << "--trace ignored: built without PROFILER_ENABLED" << std::endl;
+#endif
+
+    const auto run_start = clock::now();
+    auto window_start = run_start;
+    sf::Uint64 window_ticks = 0;
+    runner.start(ticks, dt);
+    while(!runner.wait_for(HeadlessSettings::island_report_seconds))
+    {
+        // Islands don't end ticks together, so the profiler's frames are report windows here.
+        PROFILE_FRAME_END();
+        const sf::Uint64 ticks_done = runner.get_ticks_done();
+        const double seconds = seconds_since(window_start);
+        std::cout << "progress: " << ticks_done << " of " << ticks * runner.get_island_count() << " island ticks, "
+            << (seconds > 0.0 ? static_cast<double>(ticks_done - window_ticks) / seconds : 0.0)
+            << " island ticks/s" << std::endl;
+        window_start = clock::now();
+        window_ticks = ticks_done;
+    }
+    PROFILE_FRAME_END();
+    const double run_seconds = seconds_since(run_start);
+
+    for(size_t k = 0; k < runner.get_island_count(); k++)
+    {
+        const auto& stats = runner.get_stats(k);
+        const std::string label = "island " + std::to_string(k);
+        report(runner.get_island(k), label.c_str(), ticks, stats.seconds, ticks);
+        std::cout << "  seed " << runner.get_seed(k) << ", waited " << stats.waiting_seconds << " s, "
+            << stats.emigrants << " emigrants, " << stats.immigrants << " immigrants" << std::endl;
+    }
+    const double island_ticks = static_cast<double>(ticks * runner.get_island_count());
+    std::cout << "total: " << runner.get_island_count() << " islands in " << run_seconds << " s, "
+        << (run_seconds > 0.0 ? island_ticks / run_seconds : 0.0) << " island ticks/s" << std::endl;
+
+#if PROFILER_ENABLED
+    if(!trace_path.empty() && !Profiler::get().write_chrome_trace(trace_path))
+        std::cerr << "could not write trace " << trace_path << std::endl;
+#endif
+    return 0;
+}
+
+static int run_shards(ShardRunner& runner, const size_t ticks, const float dt)
+{
+    const auto run_start = std::chrono::steady_clock::now();
+    if(!runner.run(ticks, dt))
+    {
+        std::cerr << "sharded run failed" << std::endl;
+        return 1;
+    }
+    const double run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+
+    ShardReport total;
+    for(size_t k = 0; k < runner.get_shard_count(); k++)
+    {
+        const auto& report = runner.get_report(k);
+        std::cout << "shard " << k << ": "
+            << (report.seconds > 0.0 ? static_cast<double>(ticks) / report.seconds : 0.0) << " ticks/s, "
+            << report.exchange_seconds << " s exchanging, "
+            << report.creatures << " creatures, " << report.plants << " plants, "
+            << report.departures << " departures, " << report.arrivals << " arrivals, "
+            << (ticks != 0 ? static_cast<double>(report.ghosts) / static_cast<double>(ticks) : 0.0)
+            << " ghosts/tick" << std::endl;
+        total.seconds = std::max(total.seconds, report.seconds);
+        total.creatures += report.creatures;
+        total.plants += report.plants;
+    }
+    std::cout << "total tick " << ticks << ": "
+        << (total.seconds > 0.0 ? static_cast<double>(ticks) / total.seconds : 0.0) << " ticks/s, "
+        << total.creatures << " creatures, " << total.plants << " plants, "
+        << run_seconds << " s including startup" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    size_t ticks = HeadlessSettings::default_ticks;
+    float dt = HeadlessSettings::default_dt;
+    size_t report_every = HeadlessSettings::default_report_every;
+    unsigned int seed = SimulationSettings::default_seed;
+    size_t thread_count = 0;
+    bool thread_count_set = false;
+    FoodModel food_model = FoodModel::Plants;
+    std::string load_path;
+    std::string save_path;
+    size_t save_every = 0;
+    std::string trace_path;
+    size_t island_count = 0;
+    size_t migration_interval = IslandSettings::default_migration_interval;
+    size_t migrant_count = IslandSettings::default_migrant_count;
+    size_t shard_count = 0;
+    size_t think_interval = SimulationSettings::default_think_interval;
+    size_t think_budget = SimulationSettings::default_think_budget;
+    bool sleeping_chunks = false;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+        if(has_value && std::strcmp(argv[i], "--ticks") == 0)
+            ticks = std::stoul(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--dt") == 0)
+            dt = std::stof(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--report-every") == 0)
+            report_every = std::stoul(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--seed") == 0)
+            seed = static_cast<unsigned int>(std::stoul(argv[++i]));
+        else if(has_value && std::strcmp(argv[i], "--threads") == 0)
+        {
+            thread_count = std::stoul(argv[++i]);
+            thread_count_set = true;
+        }
+        else if(has_value && std::strcmp(argv[i], "--load") == 0)
+            load_path = argv[++i];
+        else if(has_value && std::strcmp(argv[i], "--save") == 0)
+            save_path = argv[++i];
+        else if(has_value && std::strcmp(argv[i], "--save-every") == 0)
+            save_every = std::stoul(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--trace") == 0)
+            trace_path = argv[++i];
+        else if(has_value && std::strcmp(argv[i], "--islands") == 0)
+            island_count = std::stoul(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--migrate-every") == 0)
+            migration_interval = std::stoul(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--migrants") == 0)
+            migrant_count = std::stoul(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--shards") == 0)
+            shard_count = std::stoul(argv[++i]);
+        else if(std::strcmp(argv[i], "--sleep-chunks") == 0)
+            sleeping_chunks = true;
+        else if(has_value && std::strcmp(argv[i], "--think-every") == 0)
+            think_interval = std::stoul(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--think-budget") == 0)
+            think_budget = std::stoul(argv[++i]);
+        else if(has_value && std::strcmp(argv[i], "--activations") == 0)
+        {
+            ActivationFunctions::Mode mode;
+            if(!ActivationFunctions::parse_mode(argv[++i], mode))
+            {
+                print_usage();
+                return 1;
+            }
+            ActivationFunctions::set_mode(mode);
+        }
+        else if(has_value && std::strcmp(argv[i], "--weights") == 0)
+        {
+            WeightPrecision precision;
+            if(!parse_weight_precision(argv[++i], precision))
+            {
+                print_usage();
+                return 1;
+            }
+            set_weight_precision(precision);
+        }
+        else if(has_value && std::strcmp(argv[i], "--food") == 0)
+        {
+            if(!parse_food_model(argv[++i], food_model))
+            {
+                print_usage();
+                return 1;
+            }
+        }
+        else if(has_value && std::strcmp(argv[i], "--simd") == 0)
+        {
+            SimdLevel level;
+            if(!parse_simd_level(argv[++i], level))
+            {
+                print_usage();
+                return 1;
+            }
+            set_simd_level(level);
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if(shard_count != 0)
+    {
+        if(island_count != 0 || !load_path.empty() || !save_path.empty() || !trace_path.empty() ||
+            food_model != FoodModel::Plants || think_interval != SimulationSettings::default_think_interval ||
+            think_budget != SimulationSettings::default_think_budget || sleeping_chunks)
+        {
+            print_usage();
+            return 1;
+        }
+        ShardRunner runner(shard_count, seed, thread_count_set ? thread_count : 1,
+            SimulationSettings::initial_plant_count, SimulationSettings::initial_creature_count);
+        std::cout << "shards: " << runner.get_shard_count()
+            << ", seeds: " << seed << " to " << runner.get_seed(runner.get_shard_count() - 1)
+            << ", simd: " << get_simd_level_name(get_simd_level())
+            << ", activations: " << ActivationFunctions::get_mode_name(ActivationFunctions::get_mode())
+            << ", weights: " << get_weight_precision_name(get_weight_precision())
+            << ", food: " << get_food_model_name(food_model) << std::endl;
+        return run_shards(runner, ticks, dt);
+    }
+
+    if(island_count != 0)
+    {
+        if(!load_path.empty() || !save_path.empty() || sleeping_chunks)
+        {
+            print_usage();
+            return 1;
+        }
+        IslandRunner runner(island_count, seed, thread_count_set ? thread_count : 1, food_model);
+        runner.set_migration(migration_interval, migrant_count);
+        runner.set_think_rate(think_interval, think_budget);
+        std::cout << "islands: " << island_count
+            << ", seeds: " << seed << " to " << runner.get_seed(island_count - 1)
+            << ", threads per island: " << runner.get_island(0).get_thread_count()
+            << ", simd: " << get_simd_level_name(get_simd_level())
+            << ", activations: " << ActivationFunctions::get_mode_name(ActivationFunctions::get_mode())
+            << ", weights: " << get_weight_precision_name(get_weight_precision())
+            << ", food: " << get_food_model_name(food_model)
+            << ", migration: " << migrant_count << " every " << migration_interval << " ticks"
+            << ", think every: " << think_interval << ", think budget: " << think_budget << std::endl;
+        return run_islands(runner, ticks, dt, trace_path);
+    }
+
+    using clock = std::chrono::steady_clock;
+    const auto seconds_since = [](const clock::time_point start)
+    {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    };
+
+    auto simulation = new Simulation(seed, thread_count, SimulationSettings::initial_plant_count,
+        SimulationSettings::initial_creature_count, food_model);
+    simulation->set_think_rate(think_interval, think_budget);
+    simulation->set_sleeping_chunks(sleeping_chunks);
+    std::cout << "seed: " << seed
+        << ", threads: " << simulation->get_thread_count()
+        << ", simd: " << get_simd_level_name(get_simd_level())
+        << ", activations: " << ActivationFunctions::get_mode_name(ActivationFunctions::get_mode())
+        << ", weights: " << get_weight_precision_name(get_weight_precision())
+        << ", food: " << get_food_model_name(simulation->get_food_model())
+        << ", think every: " << think_interval << ", think budget: " << think_budget
+        << ", sleeping chunks: " << (sleeping_chunks ? "on" : "off") << std::endl;
+
+    if(!load_path.empty())
+    {
+        const auto load_start = clock::now();
+        if(!load_snapshot(*simulation, load_path))
+        {
+            std::cerr << "could not load snapshot " << load_path << std::endl;
+            delete simulation;
+            return 1;
+        }
+        std::cout << "loaded " << load_path << " at tick " << simulation->get_tick_count()
+            << " with food " << get_food_model_name(simulation->get_food_model())
+            << " in " << seconds_since(load_start) << " s" << std::endl;
+    }
+
+#if PROFILER_ENABLED
+    Profiler::get().set_tracing(!trace_path.empty());
+#else
+    if(!trace_path.empty())
+        std::cerr << "--trace ignored: built without PROFILER_ENABLED" << std::endl;
+#endif
+
+    SnapshotSaver saver;
+    const auto run_start = clock::now();
+    auto window_start = run_start;
+    
+    for(size_t tick = 1; tick <= ticks; tick++)
+    {
+        simulation->tick(dt);
+        PROFILE_FRAME_END();
+        
+        if(report_every != 0 && tick % report_every == 0)
+        {
+            report(*simulation, "progress", tick, seconds_since(window_start), report_every);
+#if PROFILER_ENABLED
+            std::cout << Profiler::get().format_summary();
+#endif
+            window_start = clock::now();
+        }
+
+        if(!save_path.empty() && save_every != 0 && tick % save_every == 0 && tick != ticks)
+            saver.save(*simulation, save_path);
+    }
+
+    report(*simulation, "total", ticks, seconds_since(run_start), ticks);
+
+#if PROFILER_ENABLED
+    if(!trace_path.empty() && !Profiler::get().write_chrome_trace(trace_path))
+        std::cerr << "could not write trace " << trace_path << std::endl;
+#endif
+
+    bool saved = true;
+    if(!save_path.empty())
+    {
+        saver.save(*simulation, save_path);
+        saved = saver.wait();
+        if(!saved)
+            std::cerr << "could not save snapshot " << save_path << std::endl;
+    }
+    delete simulation;
+    return saved ? 0 : 1;
+}
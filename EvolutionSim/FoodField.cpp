@@ -0,0 +1,190 @@
+﻿#include "FoodField.h"
+
+#include "Simd.h"
+
+#include <cmath>
+
+void FoodField::create(const sf::Vector2f& extent, const float cell_size, const float initial_fill)
+{
+    cell_size_ = cell_size;
+    columns_ = std::max<size_t>(1, static_cast<size_t>(std::ceil(extent.x / cell_size_)));
+    rows_ = std::max<size_t>(1, static_cast<size_t>(std::ceil(extent.y / cell_size_)));
+    biomass_.resize(columns_ * rows_);
+    next_biomass_.assign(biomass_.size(), 0.0f);
+    for(auto& biomass : biomass_)
+        biomass = random_float(initial_fill * FoodFieldSettings::capacity);
+}
+
+// One cell's next biomass from its own and its neighbours' current biomass. The SIMD row
+// kernels run exactly these operations in this order, lane by lane.
+static float grow_cell(const float biomass, const float up, const float down, const float left, const float right,
+    const float dt)
+{
+    using namespace FoodFieldSettings;
+    const float neighbours = (up + down) + (left + right) - 4.0f * biomass;
+    const float change = growth_rate * biomass * (1.0f - biomass * (1.0f / capacity)) +
+        seeding_rate * (capacity - biomass) + spread_rate * neighbours;
+    return std::min(std::max(biomass + dt * change, 0.0f), capacity);
+}
+
+// Outside the grid counts as holding as much as the cell itself, so nothing leaks over the
+// world's edge.
+static void grow_cells_scalar(const float* up, const float* row, const float* down, const size_t columns,
+    const size_t first, const size_t last, const float dt, float* out)
+{
+    for(size_t x = first; x < last; x++)
+    {
+        const float left = x == 0 ? row[x] : row[x - 1];
+        const float right = x + 1 == columns ? row[x] : row[x + 1];
+        out[x] = grow_cell(row[x], up[x], down[x], left, right, dt);
+    }
+}
+
+// One whole row; up and down are the rows around it, or the row itself at the grid's edge.
+typedef void(*GrowRowKernel)(const float* up, const float* row, const float* down, const size_t columns,
+    const float dt, float* out);
+
+static void grow_row_scalar(const float* up, const float* row, const float* down, const size_t columns,
+    const float dt, float* out)
+{
+    grow_cells_scalar(up, row, down, columns, 0, columns, dt, out);
+}
+
+#if SIMD_X86
+// The SIMD kernels only take inner cells, whose left and right neighbours are both in the row.
+// The edge cells and whatever doesn't fill a register go through grow_cells_scalar.
+SIMD_TARGET_SSE static size_t grow_cells_sse(const float* up, const float* row, const float* down,
+    const size_t columns, size_t x, const float dt, float* out)
+{
+    using namespace FoodFieldSettings;
+    for(; x + 4 < columns; x += 4)
+    {
+        const __m128 biomass = _mm_loadu_ps(row + x);
+        const __m128 neighbours = _mm_sub_ps(
+            _mm_add_ps(_mm_add_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x)),
+                _mm_add_ps(_mm_loadu_ps(row + x - 1), _mm_loadu_ps(row + x + 1))),
+            _mm_mul_ps(_mm_set1_ps(4.0f), biomass));
+        const __m128 growth = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(growth_rate), biomass),
+            _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(biomass, _mm_set1_ps(1.0f / capacity))));
+        const __m128 seeding = _mm_mul_ps(_mm_set1_ps(seeding_rate), _mm_sub_ps(_mm_set1_ps(capacity), biomass));
+        const __m128 change = _mm_add_ps(_mm_add_ps(growth, seeding), _mm_mul_ps(_mm_set1_ps(spread_rate), neighbours));
+        const __m128 next = _mm_add_ps(biomass, _mm_mul_ps(_mm_set1_ps(dt), change));
+        _mm_storeu_ps(out + x, _mm_min_ps(_mm_max_ps(next, _mm_setzero_ps()), _mm_set1_ps(capacity)));
+    }
+    return x;
+}
+
+SIMD_TARGET_SSE static void grow_row_sse(const float* up, const float* row, const float* down, const size_t columns,
+    const float dt, float* out)
+{
+    grow_cells_scalar(up, row, down, columns, 0, 1, dt, out);
+    const size_t done = grow_cells_sse(up, row, down, columns, 1, dt, out);
+    grow_cells_scalar(up, row, down, columns, done, columns, dt, out);
+}
+
+SIMD_TARGET_AVX2 static void grow_row_avx2(const float* up, const float* row, const float* down, const size_t columns,
+    const float dt, float* out)
+{
+    using namespace FoodFieldSettings;
+    grow_cells_scalar(up, row, down, columns, 0, 1, dt, out);
+    size_t x = 1;
+    for(; x + 8 < columns; x += 8)
+    {
+        const __m256 biomass = _mm256_loadu_ps(row + x);
+        const __m256 neighbours = _mm256_sub_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(up + x), _mm256_loadu_ps(down + x)),
+                _mm256_add_ps(_mm256_loadu_ps(row + x - 1), _mm256_loadu_ps(row + x + 1))),
+            _mm256_mul_ps(_mm256_set1_ps(4.0f), biomass));
+        const __m256 growth = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(growth_rate), biomass),
+            _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(biomass, _mm256_set1_ps(1.0f / capacity))));
+        const __m256 seeding = _mm256_mul_ps(_mm256_set1_ps(seeding_rate),
+            _mm256_sub_ps(_mm256_set1_ps(capacity), biomass));
+        const __m256 change = _mm256_add_ps(_mm256_add_ps(growth, seeding),
+            _mm256_mul_ps(_mm256_set1_ps(spread_rate), neighbours));
+        const __m256 next = _mm256_add_ps(biomass, _mm256_mul_ps(_mm256_set1_ps(dt), change));
+        _mm256_storeu_ps(out + x, _mm256_min_ps(_mm256_max_ps(next, _mm256_setzero_ps()), _mm256_set1_ps(capacity)));
+    }
+    // Same reason as in the AVX2 layer kernel: the SSE code below isn't VEX encoded.
+    _mm256_zeroupper();
+    x = grow_cells_sse(up, row, down, columns, x, dt, out);
+    grow_cells_scalar(up, row, down, columns, x, columns, dt, out);
+}
+#endif
+
+static GrowRowKernel get_grow_row_kernel()
+{
+#if SIMD_X86
+    switch(get_simd_level())
+    {
+    case SimdLevel::Avx2: return grow_row_avx2;
+    case SimdLevel::Sse: return grow_row_sse;
+    case SimdLevel::Scalar: break;
+    }
+#endif
+    return grow_row_scalar;
+}
+
+void FoodField::grow(const float dt, JobPool& jobs)
+{
+    if(is_empty())
+        return;
+
+    // Capturing no more than this keeps the job inside std::function's small buffer.
+    jobs.parallel_for(rows_, FoodFieldSettings::row_grain, [this, dt](const size_t begin, const size_t end)
+    {
+        const GrowRowKernel kernel = get_grow_row_kernel();
+        for(size_t y = begin; y < end; y++)
+        {
+            const float* row = biomass_.data() + y * columns_;
+            const float* up = y == 0 ? row : row - columns_;
+            const float* down = y + 1 == rows_ ? row : row + columns_;
+            kernel(up, row, down, columns_, dt, next_biomass_.data() + y * columns_);
+        }
+    });
+    biomass_.swap(next_biomass_);
+}
+
+float FoodField::eat(const sf::Vector2f& position, const float max_biomass)
+{
+    if(is_empty() || max_biomass <= 0.0f)
+        return 0.0f;
+    float& biomass = biomass_[get_row(position.y) * columns_ + get_column(position.x)];
+    const float eaten = std::min(biomass, max_biomass);
+    biomass -= eaten;
+    return eaten;
+}
+
+double FoodField::get_total_biomass() const
+{
+    double total = 0.0;
+    for(const auto biomass : biomass_)
+        total += static_cast<double>(biomass);
+    return total;
+}
+
+void FoodField::write(BinaryWriter& out) const
+{
+    out.write(cell_size_);
+    out.write(static_cast<sf::Uint64>(columns_));
+    out.write(static_cast<sf::Uint64>(rows_));
+    out.write_vector(biomass_);
+}
+
+bool FoodField::read(BinaryReader& in)
+{
+    float cell_size;
+    sf::Uint64 columns;
+    sf::Uint64 rows;
+    std::vector<float> biomass;
+    if(!in.read(cell_size) || !in.read(columns) || !in.read(rows) || !in.read_vector(biomass))
+        return false;
+    if(biomass.size() != columns * rows || (!biomass.empty() && !(cell_size > 0.0f)))
+        return false;
+
+    cell_size_ = cell_size;
+    columns_ = static_cast<size_t>(columns);
+    rows_ = static_cast<size_t>(rows);
+    biomass_ = std::move(biomass);
+    next_biomass_.assign(biomass_.size(), 0.0f);
+    return true;
+}
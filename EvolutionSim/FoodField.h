@@ -0,0 +1,110 @@
+﻿#pragma once
+#include "BinaryIO.h"
+#include "Common.h"
+#include "JobPool.h"
+
+// Plant food as a layer of biomass over a uniform grid covering world_extent, instead of
+// individual plant entities. Every cell grows logistically towards a capacity, leaks into its
+// four neighbours and slowly reseeds when bare; creatures eat from the cell they stand in.
+// Biomass is measured like plant size, so a unit of it is worth plant_energy_per_unit_size.
+//
+// The cost of a tick is one stencil pass over the grid, whatever the population. The pass
+// reads the old biomass and writes a second buffer, so rows can be updated in any order and
+// on any thread, and every SIMD level gives the same bits.
+namespace FoodFieldSettings
+{
+    static constexpr float cell_size = 8.0f;
+    // Biomass per cell, at most.
+    static constexpr float capacity = 1.0f;
+    // Logistic growth rate per second.
+    static constexpr float growth_rate = 0.2f;
+    // Regrowth of bare cells per second, as a fraction of the missing biomass.
+    static constexpr float seeding_rate = 0.002f;
+    // Exchange with each neighbour per second, as a fraction of the difference.
+    static constexpr float spread_rate = 0.2f;
+    // Cells with less than this aren't worth showing to creatures as food.
+    static constexpr float visible_biomass = 0.25f;
+    // Rows per job of the stencil pass.
+    static constexpr size_t row_grain = 16;
+}
+
+class FoodField
+{
+public:
+    // An empty field has no cells: nothing grows and there is nothing to eat.
+    FoodField() = default;
+
+    // Covers extent with cells of cell_size, each starting with a random amount between zero
+    // and initial_fill times the capacity, drawn from the current random engine.
+    void create(const sf::Vector2f& extent, const float cell_size, const float initial_fill);
+    inline bool is_empty() const { return biomass_.empty(); }
+
+    void grow(const float dt, JobPool& jobs);
+    // Takes up to max_biomass from the cell at position and returns how much it took.
+    float eat(const sf::Vector2f& position, const float max_biomass);
+
+    // Calls func(cell, centre, biomass) for every cell holding at least min_biomass that
+    // touches the square of half width radius around center, row by row.
+    template <typename F>
+    void for_each_cell_in_radius(const sf::Vector2f& center, const float radius, const float min_biomass,
+        F&& func) const;
+
+    inline size_t get_columns() const { return columns_; }
+    inline size_t get_rows() const { return rows_; }
+    inline float get_cell_size() const { return cell_size_; }
+    inline size_t get_cell_count() const { return biomass_.size(); }
+    inline float get_biomass(const size_t cell) const { return biomass_[cell]; }
+    inline sf::Vector2f get_cell_center(const size_t column, const size_t row) const
+    {
+        return {(static_cast<float>(column) + 0.5f) * cell_size_, (static_cast<float>(row) + 0.5f) * cell_size_};
+    }
+    double get_total_biomass() const;
+
+    void write(BinaryWriter& out) const;
+    bool read(BinaryReader& in);
+
+private:
+    inline size_t get_column(const float x) const;
+    inline size_t get_row(const float y) const;
+
+    float cell_size_ = 1.0f;
+    size_t columns_ = 0;
+    size_t rows_ = 0;
+    std::vector<float> biomass_;
+    // What the stencil pass writes before the buffers swap.
+    std::vector<float> next_biomass_;
+};
+
+size_t FoodField::get_column(const float x) const
+{
+    if(x <= 0.0f)
+        return 0;
+    return std::min(static_cast<size_t>(x / cell_size_), columns_ - 1);
+}
+
+size_t FoodField::get_row(const float y) const
+{
+    if(y <= 0.0f)
+        return 0;
+    return std::min(static_cast<size_t>(y / cell_size_), rows_ - 1);
+}
+
+template <typename F>
+void FoodField::for_each_cell_in_radius(const sf::Vector2f& center, const float radius, const float min_biomass,
+    F&& func) const
+{
+    if(is_empty())
+        return;
+
+    const size_t column_begin = get_column(center.x - radius);
+    const size_t column_end = get_column(center.x + radius);
+    const size_t row_begin = get_row(center.y - radius);
+    const size_t row_end = get_row(center.y + radius);
+    for(size_t row = row_begin; row <= row_end; row++)
+        for(size_t column = column_begin; column <= column_end; column++)
+        {
+            const size_t cell = row * columns_ + column;
+            if(biomass_[cell] >= min_biomass)
+                func(cell, get_cell_center(column, row), biomass_[cell]);
+        }
+}
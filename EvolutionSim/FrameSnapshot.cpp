@@ -0,0 +1,43 @@
+﻿#include "FrameSnapshot.h"
+
+void capture_frame(const Simulation& simulation, FrameSnapshot& out)
+{
+    out.tick = simulation.get_tick_count();
+
+    const PlantStore& plants = simulation.get_plants();
+    out.plant_positions.clear();
+    out.plant_sizes.clear();
+    for(size_t i = 0; i < plants.get_capacity(); i++)
+        if(plants.is_used(i))
+        {
+            out.plant_positions.push_back(plants.position[i]);
+            out.plant_sizes.push_back(plants.size[i]);
+        }
+    out.food = simulation.get_food_field();
+
+    const CreatureStore& creatures = simulation.get_creatures();
+    out.creature_positions.clear();
+    out.creature_orientations.clear();
+    out.creature_sizes.clear();
+    out.creature_colors.clear();
+#if DRAW_DEBUG_DATA
+    out.creature_energies.clear();
+    out.creature_near_plant.clear();
+    out.creature_genes.clear();
+    out.creature_diets.clear();
+#endif
+    for(size_t i = 0; i < creatures.get_capacity(); i++)
+        if(creatures.is_used(i))
+        {
+            out.creature_positions.push_back(creatures.position[i]);
+            out.creature_orientations.push_back(creatures.orientation[i]);
+            out.creature_sizes.push_back(creatures.size[i]);
+            out.creature_colors.push_back(creatures.color[i]);
+#if DRAW_DEBUG_DATA
+            out.creature_energies.push_back(creatures.energy[i]);
+            out.creature_near_plant.push_back(creatures.nearby_plant[i].is_set() ? 1 : 0);
+            out.creature_genes.push_back(creatures.gene[i]);
+            out.creature_diets.push_back(creatures.diet[i]);
+#endif
+        }
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+#include "Common.h"
+#include "Creature.h"
+#include "FoodField.h"
+#include "Simulation.h"
+
+#define DRAW_DEBUG_DATA 1 && _DEBUG
+
+// What the window needs to draw one frame, copied out of the simulation after a tick so the
+// render thread never looks at stores that are being changed. Only the used slots are kept,
+// packed, and only the fields the drawing reads.
+struct FrameSnapshot
+{
+    sf::Uint64 tick = 0;
+
+    std::vector<sf::Vector2f> plant_positions;
+    std::vector<float> plant_sizes;
+    // Empty when the food is plants.
+    FoodField food;
+
+    std::vector<sf::Vector2f> creature_positions;
+    std::vector<sf::Vector2f> creature_orientations;
+    std::vector<float> creature_sizes;
+    std::vector<Color> creature_colors;
+#if DRAW_DEBUG_DATA
+    std::vector<float> creature_energies;
+    std::vector<sf::Uint8> creature_near_plant;
+    std::vector<Gene> creature_genes;
+    std::vector<Gene> creature_diets;
+#endif
+};
+
+// Overwrites out, reusing the memory it already holds.
+void capture_frame(const Simulation& simulation, FrameSnapshot& out);
@@ -0,0 +1,146 @@
+﻿#include "Islands.h"
+
+#include <chrono>
+
+bool MigrationQueue::try_push(MigrantBatch& batch)
+{
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if(tail - head_.load(std::memory_order_acquire) == IslandSettings::queue_capacity)
+        return false;
+    slots_[tail % IslandSettings::queue_capacity] = std::move(batch);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool MigrationQueue::try_pop(MigrantBatch& out)
+{
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if(head == tail_.load(std::memory_order_acquire))
+        return false;
+    out = std::move(slots_[head % IslandSettings::queue_capacity]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+IslandRunner::IslandRunner(const size_t island_count, const unsigned int seed, const size_t threads_per_island,
+    const FoodModel food_model)
+    : seed_(seed)
+{
+    islands_.reserve(island_count);
+    for(size_t k = 0; k < island_count; k++)
+    {
+        islands_.push_back(std::make_unique<Island>());
+        islands_.back()->simulation = std::make_unique<Simulation>(get_seed(k), threads_per_island,
+            SimulationSettings::initial_plant_count, SimulationSettings::initial_creature_count, food_model);
+    }
+}
+
+IslandRunner::~IslandRunner()
+{
+    join();
+}
+
+void IslandRunner::set_migration(const size_t interval, const size_t migrant_count)
+{
+    migration_interval_ = interval;
+    migrant_count_ = migrant_count;
+}
+
+void IslandRunner::set_think_rate(const size_t think_interval, const size_t think_budget)
+{
+    for(auto& island : islands_)
+        island->simulation->set_think_rate(think_interval, think_budget);
+}
+
+void IslandRunner::start(const size_t ticks, const float dt)
+{
+    join();
+    running_ = islands_.size();
+    for(size_t k = 0; k < islands_.size(); k++)
+    {
+        islands_[k]->ticks_done.store(0, std::memory_order_relaxed);
+        islands_[k]->thread = std::thread(&IslandRunner::run_island, this, k, ticks, dt);
+    }
+}
+
+bool IslandRunner::wait_for(const double seconds)
+{
+    {
+        std::unique_lock<std::mutex> lock(done_mutex_);
+        if(!done_.wait_for(lock, std::chrono::duration<double>(seconds), [this]{ return running_ == 0; }))
+            return false;
+    }
+    join();
+    return true;
+}
+
+sf::Uint64 IslandRunner::get_ticks_done() const
+{
+    sf::Uint64 total = 0;
+    for(const auto& island : islands_)
+        total += island->ticks_done.load(std::memory_order_relaxed);
+    return total;
+}
+
+void IslandRunner::join()
+{
+    for(const auto& island : islands_)
+        if(island->thread.joinable())
+            island->thread.join();
+}
+
+void IslandRunner::run_island(const size_t k, const size_t ticks, const float dt)
+{
+    using clock = std::chrono::steady_clock;
+    Island& island = *islands_[k];
+    MigrationQueue& outbound = islands_[(k + 1) % islands_.size()]->inbound;
+    Simulation& simulation = *island.simulation;
+    const bool migrating = migration_interval_ != 0 && migrant_count_ != 0;
+
+    // Spins on the queue, giving the core away between tries, and counts the time spent.
+    const auto wait_until = [&island](auto&& done)
+    {
+        if(done())
+            return;
+        const auto wait_start = clock::now();
+        while(!done())
+            std::this_thread::yield();
+        island.stats.waiting_seconds += std::chrono::duration<double>(clock::now() - wait_start).count();
+    };
+
+    island.stats.waiting_seconds = 0.0;
+    const auto run_start = clock::now();
+    MigrantBatch batch;
+    for(size_t tick = 1; tick <= ticks; tick++)
+    {
+        simulation.tick(dt);
+        island.ticks_done.store(tick, std::memory_order_relaxed);
+
+        // Counted in world ticks rather than ticks of this run, so runs can follow each other
+        // and still migrate as one long run would.
+        const sf::Uint64 world_tick = simulation.get_tick_count();
+        if(!migrating || world_tick % migration_interval_ != 0)
+            continue;
+
+        const sf::Uint64 epoch = world_tick / migration_interval_;
+        batch.epoch = epoch;
+        batch.migrants.clear();
+        simulation.emigrate(migrant_count_, batch.migrants);
+        island.stats.emigrants += batch.migrants.size();
+        wait_until([&]{ return outbound.try_push(batch); });
+
+        // Batches arrive in the order they were sent, so this is the previous island's batch
+        // of the last epoch.
+        if(epoch > 1)
+        {
+            wait_until([&]{ return island.inbound.try_pop(batch); });
+            simulation.immigrate(batch.migrants);
+            island.stats.immigrants += batch.migrants.size();
+        }
+    }
+    island.stats.seconds = std::chrono::duration<double>(clock::now() - run_start).count();
+
+    std::lock_guard<std::mutex> lock(done_mutex_);
+    running_--;
+    done_.notify_all();
+}
@@ -0,0 +1,117 @@
+﻿#pragma once
+#include "Simulation.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Island model: several independent worlds, each with its own seed, ticking side by side on a
+// thread of their own. Every migration interval each island sends a few creatures picked at
+// random to the next island in a ring, and takes in the batch the previous island sent one
+// interval earlier. Worlds scale with cores without a single tick having to be parallel.
+//
+// Because arrivals always land a whole interval after they left, an island only waits when
+// its neighbour is more than an interval behind, and a run is reproducible however the
+// threads happen to be scheduled.
+namespace IslandSettings
+{
+    static constexpr size_t default_migration_interval = 600;
+    static constexpr size_t default_migrant_count = 10;
+    // Batches in flight from one island to the next. Two are enough never to deadlock; more
+    // let islands drift further apart before the one ahead has to wait.
+    static constexpr size_t queue_capacity = 4;
+}
+
+struct MigrantBatch
+{
+    // Which migration the batch is from, counting from 1.
+    sf::Uint64 epoch = 0;
+    std::vector<CreatureGenome> migrants;
+};
+
+// Ring of batches from one island to the next, without locks: exactly one thread pushes and
+// exactly one pops. The indices hand slots over with release and acquire, so each slot is
+// only ever touched by one side at a time.
+class MigrationQueue
+{
+public:
+    // False when full; batch is only moved from on success.
+    bool try_push(MigrantBatch& batch);
+    // False when empty.
+    bool try_pop(MigrantBatch& out);
+
+private:
+    std::array<MigrantBatch, IslandSettings::queue_capacity> slots_;
+    // Both only count up; the slot is the index modulo the capacity. head_ is written by the
+    // popping thread, tail_ by the pushing one, so they get a cache line each.
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+struct IslandStats
+{
+    // Wall time of the island's thread over the last run, and how much of it went to
+    // waiting for its neighbours.
+    double seconds = 0.0;
+    double waiting_seconds = 0.0;
+    // Over every run so far.
+    size_t emigrants = 0;
+    size_t immigrants = 0;
+};
+
+class IslandRunner
+{
+public:
+    // Island k is a fresh world with seed + k. threads_per_island sizes each world's own
+    // JobPool; 1 keeps every island to its one thread.
+    IslandRunner(const size_t island_count, const unsigned int seed, const size_t threads_per_island,
+        const FoodModel food_model);
+    // Waits for a run still going.
+    ~IslandRunner();
+    IslandRunner(const IslandRunner&) = delete;
+    IslandRunner& operator=(const IslandRunner&) = delete;
+
+    // An interval of 0 or no migrants turns migration off. Only between runs.
+    void set_migration(const size_t interval, const size_t migrant_count);
+    // Simulation::set_think_rate for every island. Only between runs.
+    void set_think_rate(const size_t think_interval, const size_t think_budget);
+
+    // Starts every island ticking ticks times by dt on its own thread and returns right away.
+    void start(const size_t ticks, const float dt);
+    // Waits up to seconds for the run to end; true once every island is done.
+    bool wait_for(const double seconds);
+    // Ticks done so far in this run, summed over the islands. Fine to call while running.
+    sf::Uint64 get_ticks_done() const;
+
+    inline size_t get_island_count() const { return islands_.size(); }
+    // Only between runs.
+    inline const Simulation& get_island(const size_t k) const { return *islands_[k]->simulation; }
+    inline const IslandStats& get_stats(const size_t k) const { return islands_[k]->stats; }
+    inline unsigned int get_seed(const size_t k) const { return seed_ + static_cast<unsigned int>(k); }
+
+private:
+    struct Island
+    {
+        std::unique_ptr<Simulation> simulation;
+        // Batches from the previous island in the ring.
+        MigrationQueue inbound;
+        IslandStats stats;
+        std::atomic<sf::Uint64> ticks_done{0};
+        std::thread thread;
+    };
+
+    void run_island(const size_t k, const size_t ticks, const float dt);
+    void join();
+
+    std::vector<std::unique_ptr<Island>> islands_;
+    unsigned int seed_;
+    size_t migration_interval_ = IslandSettings::default_migration_interval;
+    size_t migrant_count_ = IslandSettings::default_migrant_count;
+
+    std::mutex done_mutex_;
+    std::condition_variable done_;
+    size_t running_ = 0;
+};
@@ -0,0 +1,125 @@
+﻿#include "JobPool.h"
+
+JobPool::JobPool(size_t thread_count)
+{
+    if(thread_count == 0)
+        thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    thread_count = std::min(thread_count, JobPoolSettings::max_threads);
+
+    workers_.reserve(thread_count);
+    for(size_t i = 0; i < thread_count; i++)
+        workers_.emplace_back(new Worker());
+
+    threads_.reserve(thread_count - 1);
+    for(size_t i = 1; i < thread_count; i++)
+        threads_.emplace_back(&JobPool::worker_loop, this, i);
+}
+
+JobPool::~JobPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for(auto& thread : threads_)
+        thread.join();
+}
+
+void JobPool::parallel_for(const size_t count, const size_t grain, const RangeFunction& func)
+{
+    if(count == 0)
+        return;
+
+    const size_t step = std::max<size_t>(1, grain);
+    if(workers_.size() == 1 || count <= step)
+    {
+        func(0, count);
+        return;
+    }
+
+    // The job has to be published before its first task: a worker still spinning on the
+    // previous job may pick the new tasks up straight away.
+    const size_t task_count = (count + step - 1) / step;
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        job_ = &func;
+        tasks_left_.store(task_count);
+        job_generation_++;
+    }
+
+    // Deal the ranges out round-robin; stealing evens out whatever the split gets wrong.
+    for(size_t i = 0; i < task_count; i++)
+    {
+        auto& worker = *workers_[i % workers_.size()];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back({i * step, std::min(count, (i + 1) * step)});
+    }
+    wake_.notify_all();
+
+    Task task;
+    while(tasks_left_.load() != 0)
+    {
+        if(pop_or_steal(0, task))
+            run_task(task);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void JobPool::worker_loop(const size_t index)
+{
+    size_t seen_generation = 0;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_.wait(lock, [&]{ return stopping_ || job_generation_ != seen_generation; });
+            if(stopping_)
+                return;
+            seen_generation = job_generation_;
+        }
+
+        Task task;
+        while(tasks_left_.load() != 0)
+        {
+            if(pop_or_steal(index, task))
+                run_task(task);
+            else
+                std::this_thread::yield();
+        }
+    }
+}
+
+bool JobPool::pop_or_steal(const size_t index, Task& out)
+{
+    {
+        auto& own = *workers_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(!own.tasks.empty())
+        {
+            out = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for(size_t i = 1; i < workers_.size(); i++)
+    {
+        auto& victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.tasks.empty())
+        {
+            out = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobPool::run_task(const Task& task)
+{
+    (*job_)(task.begin, task.end);
+    tasks_left_.fetch_sub(1);
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+#include "Common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+
+// Fixed set of worker threads with one task deque each. Workers take their own newest task
+// first and steal the oldest task of another worker when they run dry, so uneven chunks
+// still spread over every core. The calling thread works as worker 0 while it waits.
+class JobPool
+{
+public:
+    typedef std::function<void(size_t begin, size_t end)> RangeFunction;
+
+    // thread_count counts the calling thread; 0 uses every hardware thread.
+    explicit JobPool(size_t thread_count = 0);
+    ~JobPool();
+    JobPool(const JobPool&) = delete;
+    JobPool& operator=(const JobPool&) = delete;
+
+    // Calls func on consecutive ranges of at most grain items covering [0, count) and returns
+    // once all of them have finished. Ranges never overlap, so func may write per-item state.
+    void parallel_for(const size_t count, const size_t grain, const RangeFunction& func);
+    inline size_t get_thread_count() const { return workers_.size(); }
+
+private:
+    struct Task
+    {
+        size_t begin;
+        size_t end;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void worker_loop(const size_t index);
+    bool pop_or_steal(const size_t index, Task& out);
+    void run_task(const Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    size_t job_generation_ = 0;
+
+    const RangeFunction* job_ = nullptr;
+    std::atomic<size_t> tasks_left_{0};
+};
+
+namespace JobPoolSettings
+{
+    static constexpr size_t max_threads = 256;
+}
@@ -1,222 +1,539 @@
 ﻿#include "NeuralNetwork.h"
 
-float ActivationFunctions::binary_step(const float x)
+#include "Profiler.h"
+#include "Simd.h"
+
+static WeightPrecision current_precision = WeightPrecision::Float;
+
+WeightPrecision get_weight_precision()
 {
-    return x >= 0.0f ? 1.0f : 0.0f;
+    return current_precision;
 }
 
-float ActivationFunctions::sign(const float x)
+void set_weight_precision(const WeightPrecision precision)
 {
-    if (x > 0) return 1;
-    if (x < 0) return -1;
-    return 0;
+    current_precision = precision;
 }
 
-float ActivationFunctions::linear(const float x)
+const char* get_weight_precision_name(const WeightPrecision precision)
 {
-    return x;
+    switch(precision)
+    {
+    case WeightPrecision::Float: return "float";
+    case WeightPrecision::Int8: return "int8";
+    case WeightPrecision::Validate: return "validate";
+    }
+    return "unknown";
 }
 
-float ActivationFunctions::sigmoid(const float x)
+bool parse_weight_precision(const std::string& name, WeightPrecision& out)
 {
-    return 1.0f / (1.0f + exp(-x));
+    for(const auto precision : {WeightPrecision::Float, WeightPrecision::Int8, WeightPrecision::Validate})
+        if(name == get_weight_precision_name(precision))
+        {
+            out = precision;
+            return true;
+        }
+    return false;
 }
 
-float ActivationFunctions::tanh(const float x)
+NeuralLayer::NeuralLayer(const size_t inputs, const size_t outputs)
 {
-    return tanhf(x);
+    input_count = inputs;
+    output_count = outputs;
+    weight_rows.reserve(inputs);
+    for(size_t i = 0; i < inputs; i++)
+        weight_rows.emplace_back(outputs, get_weight_precision() != WeightPrecision::Float);
+    biases.assign(outputs, 0.0f);
+    activation_ids.resize(outputs);
 }
 
-float ActivationFunctions::re_lu(const float x)
+NeuralNetwork::NeuralNetwork()
 {
-    return std::max(0.0f, x);
+    layers.reserve(NeuralNetworkSettings::depth + 1);
+    for(size_t i = 0; i <= NeuralNetworkSettings::depth; i++)
+    {
+        const size_t inputs = i == 0 ? static_cast<size_t>(InputNode::Num) : NeuralNetworkSettings::width;
+        const size_t outputs = i == NeuralNetworkSettings::depth ? static_cast<size_t>(OutputNode::Num) : NeuralNetworkSettings::width;
+        layers.emplace_back(inputs, outputs);
+        
+        auto& layer = layers.back();
+        for(auto& activation_id : layer.activation_ids)
+            activation_id = random_activation_id();
+        for(auto& row : layer.weight_rows)
+        {
+            float* weights = row.make_unique();
+            for(size_t o = 0; o < layer.output_count; o++)
+                weights[o] = random_float(-2.0f, 2.0f);
+        }
+    }
+    calculate_complexity();
+    update_quantised_weights();
 }
 
-float ActivationFunctions::leaky_re_lu(const float x)
+NeuralNetwork::NeuralNetwork(std::vector<NeuralLayer> from_layers)
+    : layers(std::move(from_layers))
 {
-    return std::max(0.1f * x, x);
+    calculate_complexity();
+    update_quantised_weights();
 }
 
-float ActivationFunctions::elu(const float x)
+NeuralNetwork::NeuralNetwork(const NeuralNetwork& other)
 {
-    return x >= 0 ? x : alpha * (exp(x) - 1);
+    copy_mutated_from(other);
 }
 
-ActivationFunctions::ActivationFunction::ActivationFunction(float func(const float x), const float complexity)
+// for_each_bernoulli_hit over the elements of all layers as one sequence, count(layer) of
+// them per layer, so a whole network costs one draw per hit plus one.
+template <typename Count, typename Hit>
+static void for_each_layer_hit(std::vector<NeuralLayer>& layers, const float chance, Count&& count, Hit&& hit)
 {
-    this->func_ = func;
-    this->complexity_ = complexity;
+    size_t total = 0;
+    for(const auto& layer : layers)
+        total += count(layer);
+
+    size_t l = 0;
+    size_t layer_begin = 0;
+    for_each_bernoulli_hit(get_random_engine(), total, chance, [&](const size_t i)
+    {
+        while(i >= layer_begin + count(layers[l]))
+            layer_begin += count(layers[l++]);
+        hit(layers[l], i - layer_begin);
+    });
 }
 
-inline float ActivationFunctions::ActivationFunction::parse_value(const float x) const
+void NeuralNetwork::copy_mutated_from(const NeuralNetwork& parent)
 {
-    return func_(x);
+    // Copying the layers only shares the parent's weight rows; a row is copied when a
+    // mutation first lands in it.
+    layers = parent.layers;
+    const auto node_count = [](const NeuralLayer& layer){ return layer.output_count; };
+    const auto weight_count = [](const NeuralLayer& layer){ return layer.input_count * layer.output_count; };
+    for_each_layer_hit(layers, NeuralNetworkSettings::node_bias_mutation_chance, node_count,
+        [](NeuralLayer& layer, const size_t i){ layer.biases[i] = perturb_node_bias(layer.biases[i]); });
+    for_each_layer_hit(layers, NeuralNetworkSettings::node_activation_function_mutation_chance, node_count,
+        [](NeuralLayer& layer, const size_t i){ layer.activation_ids[i] = random_activation_id(); });
+    for_each_layer_hit(layers, NeuralNetworkSettings::connection_weight_mutation_chance, weight_count,
+        [](NeuralLayer& layer, const size_t i)
+        {
+            float& weight = layer.weight_rows[i / layer.output_count].make_unique()[i % layer.output_count];
+            weight = perturb_connection_weight(weight);
+        });
+    calculate_complexity();
+    update_quantised_weights();
 }
 
-float ActivationFunctions::ActivationFunction::get_complexity() const
+void NeuralNetwork::write(BinaryWriter& out) const
 {
-    return complexity_;
+    out.write<sf::Uint32>(static_cast<sf::Uint32>(layers.size()));
+    for(const auto& layer : layers)
+    {
+        out.write<sf::Uint32>(static_cast<sf::Uint32>(layer.input_count));
+        out.write<sf::Uint32>(static_cast<sf::Uint32>(layer.output_count));
+        // Written as one flat vector, the same as before rows were shared.
+        out.write<sf::Uint64>(layer.input_count * layer.output_count);
+        for(const auto& row : layer.weight_rows)
+            out.append(row.data(), row.size() * sizeof(float));
+        out.write_vector(layer.biases);
+        out.write_vector(layer.activation_ids);
+    }
 }
 
-Node::Node(const bool is_input)
+bool NeuralNetwork::read(BinaryReader& in, WeightBlockInterner& interner)
 {
-    is_input_node = is_input;
-    activation_function_ = &ActivationFunctions::functions[random() % ActivationFunctions::functions.size()];
-    bias_ = 0.0f;
+    sf::Uint32 layer_count;
+    if(!in.read(layer_count) || layer_count > NeuralNetworkSettings::depth + 1)
+        return false;
+
+    layers.resize(layer_count);
+    std::vector<float> weights;
+    size_t expected_inputs = static_cast<size_t>(InputNode::Num);
+    for(auto& layer : layers)
+    {
+        sf::Uint32 input_count;
+        sf::Uint32 output_count;
+        if(!in.read(input_count) || !in.read(output_count))
+            return false;
+        layer.input_count = input_count;
+        layer.output_count = output_count;
+        if(layer.input_count != expected_inputs || layer.output_count > NeuralNetworkSettings::max_layer_size)
+            return false;
+        expected_inputs = layer.output_count;
+
+        if(!in.read_vector(weights) || !in.read_vector(layer.biases) || !in.read_vector(layer.activation_ids))
+            return false;
+        if(weights.size() != layer.input_count * layer.output_count ||
+            layer.biases.size() != layer.output_count ||
+            layer.activation_ids.size() != layer.output_count)
+            return false;
+        for(const auto activation_id : layer.activation_ids)
+            if(activation_id >= ActivationFunctions::count)
+                return false;
+
+        layer.weight_rows.clear();
+        for(size_t i = 0; i < layer.input_count; i++)
+            layer.weight_rows.push_back(interner.intern(weights.data() + i * layer.output_count, layer.output_count,
+                get_weight_precision() != WeightPrecision::Float));
+    }
+    if(expected_inputs != static_cast<size_t>(OutputNode::Num))
+        return false;
+
+    calculate_complexity();
+    update_quantised_weights();
+    return true;
 }
 
-Node::Node(const Node& other)
+// The layer kernels add rows[i].data()[o] * in[i] onto out[o]. Vector lanes run
+// across neurons, so each neuron still sums its inputs one at a time and in order, and
+// multiplies and adds are kept separate: every level gives the same bits as the scalar loop.
+typedef void(*AccumulateLayerKernel)(const WeightBlock* rows, const float* in,
+    const size_t input_count, const size_t output_count, float* out);
+
+static void accumulate_layer_columns(const WeightBlock* rows, const float* in,
+    const size_t input_count, const size_t output_count, const size_t first, float* out)
 {
-    activation_function_ = other.activation_function_;
-    bias_ = other.bias_;
-    is_input_node = other.is_input_node;
-    if(random_chance(NeuralNetworkSettings::node_bias_mutation_chance))
-        bias_ = bias_ *
-            random_float(1 - NeuralNetworkSettings::node_bias_mutation_delta,
-                1 + NeuralNetworkSettings::node_bias_mutation_delta) +
-            random_float(-NeuralNetworkSettings::node_bias_mutation_delta,
-                NeuralNetworkSettings::node_bias_mutation_delta);
+    for(size_t o = first; o < output_count; o++)
+        for(size_t i = 0; i < input_count; i++)
+            out[o] += rows[i].data()[o] * in[i];
+}
 
-    if(random_chance(NeuralNetworkSettings::node_activation_function_mutation_chance))
-        activation_function_ = &ActivationFunctions::functions[random() % ActivationFunctions::functions.size()];
-    
+static void accumulate_layer_scalar(const WeightBlock* rows, const float* in,
+    const size_t input_count, const size_t output_count, float* out)
+{
+    accumulate_layer_columns(rows, in, input_count, output_count, 0, out);
 }
 
-Node::~Node()
+#if SIMD_X86
+SIMD_TARGET_SSE static size_t accumulate_layer_sse_columns(const WeightBlock* rows, const float* in,
+    const size_t input_count, const size_t output_count, size_t first, float* out)
 {
-    for(auto& connection : connections_)
-        delete connection;
-    connections_.clear();
+    for(; first + 4 <= output_count; first += 4)
+    {
+        __m128 sum = _mm_loadu_ps(out + first);
+        for(size_t i = 0; i < input_count; i++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[i].data() + first), _mm_set1_ps(in[i])));
+        _mm_storeu_ps(out + first, sum);
+    }
+    return first;
 }
 
-void Node::calculate_output()
+SIMD_TARGET_SSE static void accumulate_layer_sse(const WeightBlock* rows, const float* in,
+    const size_t input_count, const size_t output_count, float* out)
 {
-    output_ = bias_;
-    for(const auto i : connections_)
-        output_ += i->from->get_value(last_request_id_) * i->weight;
-    output_ = activation_function_->parse_value(output_);
+    const size_t done = accumulate_layer_sse_columns(rows, in, input_count, output_count, 0, out);
+    accumulate_layer_columns(rows, in, input_count, output_count, done, out);
 }
 
-float Node::get_value(const sf::Uint8 request_id)
+SIMD_TARGET_AVX2 static void accumulate_layer_avx2(const WeightBlock* rows, const float* in,
+    const size_t input_count, const size_t output_count, float* out)
 {
-    if(request_id == last_request_id_ || is_input_node)
-        return output_;
-    last_request_id_ = request_id;
-    calculate_output();
-    return output_;
+    size_t first = 0;
+    for(; first + 8 <= output_count; first += 8)
+    {
+        __m256 sum = _mm256_loadu_ps(out + first);
+        for(size_t i = 0; i < input_count; i++)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[i].data() + first), _mm256_set1_ps(in[i])));
+        _mm256_storeu_ps(out + first, sum);
+    }
+    // The SSE code below isn't VEX encoded; with the upper halves still dirty every one of its
+    // instructions would pay for the switch.
+    _mm256_zeroupper();
+    first = accumulate_layer_sse_columns(rows, in, input_count, output_count, first, out);
+    accumulate_layer_columns(rows, in, input_count, output_count, first, out);
 }
+#endif
 
-void Node::add_connection(Node* other, const float weight)
+static AccumulateLayerKernel get_accumulate_layer_kernel()
 {
-    connections_.push_back(new Connection(other, weight));
+#if SIMD_X86
+    switch(get_simd_level())
+    {
+    case SimdLevel::Avx2: return accumulate_layer_avx2;
+    case SimdLevel::Sse: return accumulate_layer_sse;
+    case SimdLevel::Scalar: break;
+    }
+#endif
+    return accumulate_layer_scalar;
 }
 
-Connection::Connection(Node* from, const float weight)
+// The int8 kernels add rows[i].get_quantised()[o] * (in[i] * rows[i].get_quantised_scale())
+// onto out[o], the same way and in the same order as the float kernels do, so every level
+// gives the same bits here too. Each row's int8 values and scaled input are looked up once
+// per layer rather than once per group of neurons.
+struct QuantisedLayerInputs
+{
+    const sf::Int8* weights[NeuralNetworkSettings::max_layer_size];
+    float in[NeuralNetworkSettings::max_layer_size];
+};
+
+static void get_quantised_layer_inputs(const WeightBlock* rows, const float* in, const size_t input_count,
+    QuantisedLayerInputs& out)
 {
-    this->from = from;
-    this->weight = weight;
+    for(size_t i = 0; i < input_count; i++)
+    {
+        out.weights[i] = rows[i].get_quantised();
+        out.in[i] = in[i] * rows[i].get_quantised_scale();
+    }
 }
 
-NeuralNetwork::NeuralNetwork()
+static void accumulate_quantised_columns(const QuantisedLayerInputs& inputs,
+    const size_t input_count, const size_t output_count, const size_t first, float* out)
 {
-    for (auto& input : inputs)
-        input = new Node(true);
-    
-    auto internal_node_count = NeuralNetworkSettings::width * NeuralNetworkSettings::depth;
-    internal_nodes.reserve(internal_node_count);
-    for(size_t i = 0; i < internal_node_count; i++)
+    for(size_t o = first; o < output_count; o++)
+        for(size_t i = 0; i < input_count; i++)
+            out[o] += static_cast<float>(inputs.weights[i][o]) * inputs.in[i];
+}
+
+static void accumulate_quantised_scalar(const WeightBlock* rows, const float* in,
+    const size_t input_count, const size_t output_count, float* out)
+{
+    QuantisedLayerInputs inputs;
+    get_quantised_layer_inputs(rows, in, input_count, inputs);
+    accumulate_quantised_columns(inputs, input_count, output_count, 0, out);
+}
+
+#if SIMD_X86
+SIMD_TARGET_SSE static size_t accumulate_quantised_sse_columns(const QuantisedLayerInputs& inputs,
+    const size_t input_count, const size_t output_count, size_t first, float* out)
+{
+    for(; first + 4 <= output_count; first += 4)
     {
-        auto new_node = new Node(false);
-        internal_nodes.emplace_back(new_node);
-        if(i / NeuralNetworkSettings::width == 0)
+        __m128 sum = _mm_loadu_ps(out + first);
+        for(size_t i = 0; i < input_count; i++)
         {
-            for (auto& input : inputs)
-                new_node->add_connection(input, random_float(-2.0f, 2.0f));
+            // SSE2 has no sign extending load: put each byte at the top of its lane and shift
+            // it back down.
+            sf::Int32 bytes;
+            std::memcpy(&bytes, inputs.weights[i] + first, sizeof(bytes));
+            __m128i lanes = _mm_cvtsi32_si128(bytes);
+            lanes = _mm_unpacklo_epi8(lanes, lanes);
+            lanes = _mm_srai_epi32(_mm_unpacklo_epi16(lanes, lanes), 24);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(lanes), _mm_set1_ps(inputs.in[i])));
         }
-        else
+        _mm_storeu_ps(out + first, sum);
+    }
+    return first;
+}
+
+SIMD_TARGET_SSE static void accumulate_quantised_sse(const WeightBlock* rows, const float* in,
+    const size_t input_count, const size_t output_count, float* out)
+{
+    QuantisedLayerInputs inputs;
+    get_quantised_layer_inputs(rows, in, input_count, inputs);
+    const size_t done = accumulate_quantised_sse_columns(inputs, input_count, output_count, 0, out);
+    accumulate_quantised_columns(inputs, input_count, output_count, done, out);
+}
+
+SIMD_TARGET_AVX2 static void accumulate_quantised_avx2(const WeightBlock* rows, const float* in,
+    const size_t input_count, const size_t output_count, float* out)
+{
+    QuantisedLayerInputs inputs;
+    get_quantised_layer_inputs(rows, in, input_count, inputs);
+    size_t first = 0;
+    for(; first + 8 <= output_count; first += 8)
+    {
+        __m256 sum = _mm256_loadu_ps(out + first);
+        for(size_t i = 0; i < input_count; i++)
         {
-            for(size_t j = 0; j < NeuralNetworkSettings::width; j++)
-                new_node->add_connection(internal_nodes[(i / NeuralNetworkSettings::width - 1) * NeuralNetworkSettings::width + j], random_float(-2.0f, 2.0f));
+            const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(inputs.weights[i] + first));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes)),
+                _mm256_set1_ps(inputs.in[i])));
         }
-        complexity_ += new_node->get_complexity();
+        _mm256_storeu_ps(out + first, sum);
     }
+    _mm256_zeroupper();
+    first = accumulate_quantised_sse_columns(inputs, input_count, output_count, first, out);
+    accumulate_quantised_columns(inputs, input_count, output_count, first, out);
+}
+#endif
 
-    for (auto& output : outputs)
+static AccumulateLayerKernel get_accumulate_quantised_layer_kernel()
+{
+#if SIMD_X86
+    switch(get_simd_level())
     {
-        const auto new_node = new Node(false);
-        output = new_node;
-        complexity_ += new_node->get_complexity();
-        
-        for(size_t j = 0; j < NeuralNetworkSettings::width; j++)
-            new_node->add_connection(internal_nodes[internal_nodes.size() - 1 - j], random_float(-2.0f, 2.0f));
+    case SimdLevel::Avx2: return accumulate_quantised_avx2;
+    case SimdLevel::Sse: return accumulate_quantised_sse;
+    case SimdLevel::Scalar: break;
     }
+#endif
+    return accumulate_quantised_scalar;
 }
 
-NeuralNetwork::NeuralNetwork(const NeuralNetwork& other)
+void NeuralNetwork::get_values(const float* in, float* out) const
 {
-    for(size_t i = 0; i < static_cast<size_t>(InputNode::Num); i++)
-        inputs[i] = new Node(*other.inputs[i]);
+    evaluate(in, out, get_accumulate_layer_kernel(), ActivationFunctions::get_layer_kernel());
+}
+
+void NeuralNetwork::get_quantised_values(const float* in, float* out) const
+{
+    evaluate(in, out, has_quantised_weights() ? get_accumulate_quantised_layer_kernel() : get_accumulate_layer_kernel(),
+        ActivationFunctions::get_layer_kernel());
+}
 
-    internal_nodes.reserve(other.internal_nodes.size());
-    for(size_t i = 0; i < other.internal_nodes.size(); i++)
+void NeuralNetwork::get_values_batch(const NeuralNetwork* const* networks, const size_t count,
+    const float* in, float* out, float* quantised_out)
+{
+    const auto kernel = get_accumulate_layer_kernel();
+    const auto quantised_kernel = get_accumulate_quantised_layer_kernel();
+    const auto activate = ActivationFunctions::get_layer_kernel();
+    const bool think_quantised = get_weight_precision() == WeightPrecision::Int8;
+    for(size_t i = 0; i < count; i++)
     {
-        auto new_node =new Node(*other.internal_nodes[i]);
-        internal_nodes.push_back(new_node);
-        
-        if(i / NeuralNetworkSettings::width == 0)
-        {
-            for(size_t j = 0; j < static_cast<size_t>(InputNode::Num); j++)
-                new_node->add_connection(inputs[j],
-                    mutate_connection_weight(other.internal_nodes[i]->get_connections()[j]->weight));
-        }
-        else
-        {
-            for(size_t j = 0; j < NeuralNetworkSettings::width; j++)
-                new_node->add_connection(internal_nodes[(i / NeuralNetworkSettings::width - 1) * NeuralNetworkSettings::width + j],
-                    mutate_connection_weight(other.internal_nodes[i]->get_connections()[j]->weight));
-        }
-        complexity_ += new_node->get_complexity();
+        if(!networks[i])
+            continue;
+        const float* network_in = in + i * static_cast<size_t>(InputNode::Num);
+        float* network_out = out + i * static_cast<size_t>(OutputNode::Num);
+        const bool has_quantised = networks[i]->has_quantised_weights();
+        networks[i]->evaluate(network_in, network_out, think_quantised && has_quantised ? quantised_kernel : kernel,
+            activate);
+        if(quantised_out)
+            networks[i]->evaluate(network_in, quantised_out + i * static_cast<size_t>(OutputNode::Num),
+                has_quantised ? quantised_kernel : kernel, activate);
     }
+}
 
-    for(size_t i = 0; i < static_cast<size_t>(OutputNode::Num); i++)
+void NeuralNetwork::evaluate(const float* in, float* out, AccumulateLayerKernel kernel,
+    ActivationFunctions::LayerKernel activate) const
+{
+    float buffers[2][NeuralNetworkSettings::max_layer_size];
+    const float* layer_in = in;
+    
+    for(size_t l = 0; l < layers.size(); l++)
     {
-        const auto new_node = new Node(other.outputs[i]);
-        outputs[i] = new_node;
-        complexity_ += new_node->get_complexity();
+        const auto& layer = layers[l];
+        float* layer_out = l + 1 == layers.size() ? out : buffers[l % 2];
+        
+        for(size_t o = 0; o < layer.output_count; o++)
+            layer_out[o] = layer.biases[o];
+        
+        kernel(layer.weight_rows.data(), layer_in, layer.input_count, layer.output_count, layer_out);
         
-        for(size_t j = 0; j < NeuralNetworkSettings::width; j++)
-            new_node->add_connection(internal_nodes[internal_nodes.size() - 1 - j],
-                mutate_connection_weight(other.outputs[i]->get_connections()[j]->weight));
+        activate(layer.activation_ids.data(), layer_out, layer.output_count);
+        
+        layer_in = layer_out;
     }
 }
 
-NeuralNetwork::~NeuralNetwork()
+bool NeuralNetwork::has_quantised_weights() const
 {
-    for(const auto& input : inputs)
-        delete input;
-    for(const auto& output : outputs)
-        delete output;
-    for(const auto& internal_node : internal_nodes)
-        delete internal_node;
-    internal_nodes.clear();
+    // Rows are all made under one precision, so the first speaks for the rest.
+    return !layers.empty() && !layers.front().weight_rows.empty() && layers.front().weight_rows.front().is_quantised();
 }
 
-void NeuralNetwork::get_values(const float* in, float* out)
+void NeuralNetwork::update_quantised_weights()
 {
-    last_request_id++;
-    for(size_t i = 0; i < static_cast<size_t>(InputNode::Num); i++)
-        inputs[i]->set_value(in[i]);
-    for(size_t i = 0; i < static_cast<size_t>(OutputNode::Num); i++)
-        out[i] = outputs[i]->get_value(last_request_id);
+    for(auto& layer : layers)
+        for(auto& row : layer.weight_rows)
+            row.update_quantised();
 }
 
 float NeuralNetwork::mutate_connection_weight(const float weight)
 {
     if(!random_chance(NeuralNetworkSettings::connection_weight_mutation_chance))
         return weight;
+    return perturb_connection_weight(weight);
+}
+
+float NeuralNetwork::perturb_connection_weight(const float weight)
+{
     return weight *
         random_float(1 - NeuralNetworkSettings::connection_weight_mutation_delta,
             1 + NeuralNetworkSettings::connection_weight_mutation_delta) +
         random_float(-NeuralNetworkSettings::connection_weight_mutation_delta,
             NeuralNetworkSettings::connection_weight_mutation_delta);    
 }
+
+float NeuralNetwork::mutate_node_bias(const float bias)
+{
+    if(!random_chance(NeuralNetworkSettings::node_bias_mutation_chance))
+        return bias;
+    return perturb_node_bias(bias);
+}
+
+float NeuralNetwork::perturb_node_bias(const float bias)
+{
+    return bias *
+        random_float(1 - NeuralNetworkSettings::node_bias_mutation_delta,
+            1 + NeuralNetworkSettings::node_bias_mutation_delta) +
+        random_float(-NeuralNetworkSettings::node_bias_mutation_delta,
+            NeuralNetworkSettings::node_bias_mutation_delta);
+}
+
+sf::Uint8 NeuralNetwork::random_activation_id()
+{
+    return static_cast<sf::Uint8>(random_int() % ActivationFunctions::count);
+}
+
+void NeuralNetwork::count_weight_blocks(WeightBlockCounter& counter) const
+{
+    for(const auto& layer : layers)
+        for(const auto& row : layer.weight_rows)
+            counter.add(row);
+}
+
+void NeuralNetwork::release_weights()
+{
+    for(auto& layer : layers)
+        for(auto& row : layer.weight_rows)
+            row = WeightBlock();
+}
+
+size_t NeuralNetwork::get_structure_bytes() const
+{
+    size_t bytes = layers.capacity() * sizeof(NeuralLayer);
+    for(const auto& layer : layers)
+        bytes += layer.weight_rows.capacity() * sizeof(WeightBlock) + layer.biases.capacity() * sizeof(float) +
+            layer.activation_ids.capacity() * sizeof(sf::Uint8);
+    return bytes;
+}
+
+void NeuralNetwork::calculate_complexity()
+{
+    complexity_ = 0.0f;
+    for(const auto& layer : layers)
+        for(const auto activation_id : layer.activation_ids)
+            complexity_ += ActivationFunctions::get_complexity(activation_id);
+}
+
+void BrainBatch::reset(const size_t count)
+{
+    networks_.assign(count, nullptr);
+    inputs_.resize(count * static_cast<size_t>(InputNode::Num));
+    outputs_.resize(count * static_cast<size_t>(OutputNode::Num));
+}
+
+void BrainBatch::run(JobPool& jobs)
+{
+    const bool validate = get_weight_precision() == WeightPrecision::Validate;
+    if(validate)
+        quantised_outputs_.resize(outputs_.size());
+    jobs.parallel_for(networks_.size(), NeuralNetworkSettings::batch_grain, [this, validate](const size_t begin, const size_t end)
+    {
+        PROFILE_SCOPE("inference job");
+        const size_t row = begin * static_cast<size_t>(OutputNode::Num);
+        NeuralNetwork::get_values_batch(networks_.data() + begin, end - begin,
+            get_inputs(begin), outputs_.data() + row, validate ? quantised_outputs_.data() + row : nullptr);
+    });
+    if(!validate)
+        return;
+
+    for(size_t slot = 0; slot < networks_.size(); slot++)
+    {
+        if(!networks_[slot])
+            continue;
+        const float* exact = get_outputs(slot);
+        const float* quantised = quantised_outputs_.data() + slot * static_cast<size_t>(OutputNode::Num);
+        for(size_t o = 0; o < static_cast<size_t>(OutputNode::Num); o++)
+        {
+            const double error = std::abs(static_cast<double>(quantised[o]) - static_cast<double>(exact[o])) /
+                std::max(std::abs(static_cast<double>(exact[o])), 1.0);
+            divergence_.max_relative_error = std::max(divergence_.max_relative_error, error);
+            divergence_.total_relative_error += error;
+        }
+        for(const auto decision : {OutputNode::Reproduce, OutputNode::Attack})
+            if((exact[static_cast<size_t>(decision)] > 0.0f) != (quantised[static_cast<size_t>(decision)] > 0.0f))
+                divergence_.flips++;
+        divergence_.networks++;
+    }
+}
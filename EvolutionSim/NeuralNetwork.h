@@ -1,41 +1,11 @@
 ﻿#pragma once
+#include "ActivationFunctions.h"
+#include "BinaryIO.h"
 #include "Common.h"
+#include "JobPool.h"
+#include "WeightBlock.h"
 
-namespace ActivationFunctions
-{
-    constexpr float alpha = 0.1f;
-    float binary_step(const float x);
-    float sign(const float x);
-    float linear(const float x);
-    float sigmoid(const float x);
-    float tanh(const float x);
-    float re_lu(const float x);
-    float leaky_re_lu(const float x);
-    float elu(const float x);
-
-    class ActivationFunction
-    {
-    private:
-        float(*func_)(const float x);
-        float complexity_;
-    public:
-        ActivationFunction(float(func)(const float x), const float complexity);
-        inline float parse_value(const float x) const;
-        inline float get_complexity() const;
-    };
-    
-    static std::vector<ActivationFunction> functions = {
-        ActivationFunction(binary_step, 0.1f),
-        ActivationFunction(linear, 0.5f),
-        ActivationFunction(sigmoid, 1.75f),
-        ActivationFunction(tanh, 2.5f),
-        ActivationFunction(re_lu, 1.0f),
-        ActivationFunction(leaky_re_lu, 1.2f),
-        ActivationFunction(elu, 3.0f)
-    };
-};
-
-class Connection;
+#include <string>
 
 enum class OutputNode : size_t  // NOLINT(performance-enum-size)
 {
@@ -67,60 +37,144 @@ enum class InputNode : size_t // NOLINT(performance-enum-size)
     Num
 };
 
-class Node
+// What brains think with. Float reads the weight rows as they are. Int8 reads the copy of each
+// row rounded to 8 bits, with one scale for the row, so inference streams a quarter of the
+// bytes; the inputs and sums stay float. The float rows remain the genome that mutation
+// changes, the copy lives in the row and is shared with it, and only the rows a mutation
+// touched are rounded again, see WeightBlock.
+// Validate thinks in floats like Float but evaluates the int8 copy too, on the same inputs,
+// and keeps count of how far apart the two come out, see BrainBatch::get_divergence.
+// The int8 path gives the same bits at every SIMD level. Meant to be picked once at startup,
+// before any brain is made; brains made before then have no int8 rows and think in floats.
+enum class WeightPrecision : sf::Uint8  // NOLINT(performance-enum-size)
 {
-public:
-    explicit Node(const bool is_input);
-    Node(const Node& other);
-    Node(Node&&) = default;
-    Node& operator=(const Node&) = default;
-    Node& operator=(Node&&) = default;
-    ~Node();
-    void calculate_output();
-    float get_value(const sf::Uint8 request_id);
-    inline void set_value(const float value){output_ = value;}
-    inline void add_connection(Node* other, const float weight);
-    inline float get_complexity() const { return activation_function_->get_complexity(); }
-    inline const std::vector<Connection*>& get_connections() const { return connections_; }
-
-    bool is_input_node;
-private:
-    ActivationFunctions::ActivationFunction* activation_function_;
-    std::vector<Connection*> connections_;
-    sf::Uint8 last_request_id_ = 255;
-    float output_ = 0.0f;
-    float bias_;
+    Float,
+    Int8,
+    Validate
 };
+WeightPrecision get_weight_precision();
+void set_weight_precision(const WeightPrecision precision);
+const char* get_weight_precision_name(const WeightPrecision precision);
+bool parse_weight_precision(const std::string& name, WeightPrecision& out);
 
-class Connection
+// One dense layer. Weights are stored input-major, one shared row per input
+// (weight_rows[input].data()[output]), so the forward pass streams through them once, every
+// neuron still accumulates its inputs in order, starting from its bias, and offspring share
+// whichever rows their mutations left alone.
+struct NeuralLayer
 {
-    public:
-    Connection(Node* from, const float weight);
-    Node* from;
-    float weight;
+    NeuralLayer() = default;
+    NeuralLayer(const size_t inputs, const size_t outputs);
+    
+    size_t input_count = 0;
+    size_t output_count = 0;
+    std::vector<WeightBlock> weight_rows;
+    std::vector<float> biases;
+    std::vector<sf::Uint8> activation_ids;
 };
 
 class NeuralNetwork
 {
 public:
     NeuralNetwork();
+    // Takes the layers as they are, without mutating or drawing any random numbers.
+    explicit NeuralNetwork(std::vector<NeuralLayer> from_layers);
     NeuralNetwork(const NeuralNetwork& other);
     NeuralNetwork(NeuralNetwork&&) = default;
     NeuralNetwork& operator=(const NeuralNetwork&) = default;
     NeuralNetwork& operator=(NeuralNetwork&&) = default;
-    ~NeuralNetwork();
+    ~NeuralNetwork() = default;
+    // Turns this network into a mutated copy of parent, reusing the buffers it already has.
+    void copy_mutated_from(const NeuralNetwork& parent);
     float get_complexity_factor() const{return complexity_ / 100.0f;}
-    void get_values(const float* in, float* out);
+    void get_values(const float* in, float* out) const;
+    // The same through the int8 weights, or the float ones if the rows have no int8 copy.
+    void get_quantised_values(const float* in, float* out) const;
+    // Evaluates count networks at once, skipping null entries. in and out hold one row of
+    // InputNode::Num and OutputNode::Num values per network, back to back. With
+    // quantised_out, the int8 results go there as well, see WeightPrecision::Validate.
+    static void get_values_batch(const NeuralNetwork* const* networks, const size_t count,
+        const float* in, float* out, float* quantised_out = nullptr);
     static float mutate_connection_weight(const float weight);
-    
-    Node* inputs[static_cast<size_t>(InputNode::Num)];
-    Node* outputs[static_cast<size_t>(OutputNode::Num)];
-    std::vector<Node*> internal_nodes;
-    sf::Uint8 last_request_id = 255;
+    // The change applied to a weight once it has been picked for mutation.
+    static float perturb_connection_weight(const float weight);
+    static float mutate_node_bias(const float bias);
+    // Likewise for a bias.
+    static float perturb_node_bias(const float bias);
+    static sf::Uint8 random_activation_id();
+
+    void write(BinaryWriter& out) const;
+    // Replaces the layers with ones written by write, checking that their shapes add up.
+    // Rows equal to one the interner has seen before share its block.
+    bool read(BinaryReader& in, WeightBlockInterner& interner);
+    void count_weight_blocks(WeightBlockCounter& counter) const;
+    // Lets go of the weight rows but keeps every buffer, for a brain that won't be evaluated
+    // again until copy_mutated_from refills it.
+    void release_weights();
+    // What the layers take on the heap, without the weight rows they hold.
+    size_t get_structure_bytes() const;
+
+    // Hidden layers first, the output layer last.
+    std::vector<NeuralLayer> layers;
 private:
+    void calculate_complexity();
+    // Rounds the rows written to since they last were, see WeightBlock::update_quantised.
+    void update_quantised_weights();
+    void evaluate(const float* in, float* out,
+        void(*kernel)(const WeightBlock*, const float*, const size_t, const size_t, float*),
+        ActivationFunctions::LayerKernel activate) const;
+    bool has_quantised_weights() const;
+    
     float complexity_ = 0.0f;
 };
 
+// How far the int8 weights take brains from the float ones, over every evaluation since the
+// batch was made. Outputs are compared one by one as |int8 - float| / max(|float|, 1), since
+// they are unbounded and mostly far from 1. A flip is a Reproduce or Attack output landing on
+// the other side of zero, which changes what the creature does.
+struct BrainDivergence
+{
+    sf::Uint64 networks = 0;
+    double max_relative_error = 0.0;
+    double total_relative_error = 0.0;
+    sf::Uint64 flips = 0;
+
+    // Reproduce and Attack for each network.
+    static constexpr size_t decisions_per_network = 2;
+
+    inline double get_mean_relative_error() const
+    {
+        return networks > 0 ? total_relative_error / static_cast<double>(networks * static_cast<size_t>(OutputNode::Num)) : 0.0;
+    }
+    inline double get_flip_rate() const
+    {
+        return networks > 0 ? static_cast<double>(flips) / static_cast<double>(networks * decisions_per_network) : 0.0;
+    }
+};
+
+// Brain inputs and outputs for one tick, one row per creature slot, so the whole
+// population is evaluated in one pass before anyone acts. Rows without a network are skipped.
+class BrainBatch
+{
+public:
+    void reset(const size_t count);
+    void run(JobPool& jobs);
+    inline size_t size() const { return networks_.size(); }
+    inline void set_network(const size_t slot, const NeuralNetwork* network) { networks_[slot] = network; }
+    inline const NeuralNetwork* get_network(const size_t slot) const { return networks_[slot]; }
+    inline float* get_inputs(const size_t slot) { return inputs_.data() + slot * static_cast<size_t>(InputNode::Num); }
+    inline const float* get_outputs(const size_t slot) const { return outputs_.data() + slot * static_cast<size_t>(OutputNode::Num); }
+    // Only counted while the precision is Validate.
+    inline const BrainDivergence& get_divergence() const { return divergence_; }
+
+private:
+    std::vector<const NeuralNetwork*> networks_;
+    std::vector<float> inputs_;
+    std::vector<float> outputs_;
+    std::vector<float> quantised_outputs_;
+    BrainDivergence divergence_;
+};
+
 namespace NeuralNetworkSettings
 {
     static constexpr float node_bias_mutation_chance = 0.01f;
@@ -131,4 +185,10 @@ namespace NeuralNetworkSettings
     
     static constexpr size_t width = static_cast<size_t>(InputNode::Num) * 2;
     static constexpr size_t depth = 5;
+    
+    static constexpr size_t max_layer_size = std::max({
+        width, static_cast<size_t>(InputNode::Num), static_cast<size_t>(OutputNode::Num)});
+
+    // Networks per job when a batch is spread over threads.
+    static constexpr size_t batch_grain = 128;
 }
\ No newline at end of file
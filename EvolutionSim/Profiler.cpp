@@ -0,0 +1,183 @@
+﻿#include "Profiler.h"
+
+#if PROFILER_ENABLED
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+Profiler& Profiler::get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+sf::Int64 Profiler::now()
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+Profiler::ThreadBuffer& Profiler::get_thread_buffer()
+{
+    // Buffers belong to the profiler rather than the thread, so zones of a thread that has
+    // already exited still make it into the next end_frame.
+    thread_local ThreadBuffer* buffer = nullptr;
+    if(!buffer)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.emplace_back(new ThreadBuffer());
+        buffer = threads_.back().get();
+        buffer->thread_id = static_cast<sf::Uint32>(threads_.size() - 1);
+    }
+    return *buffer;
+}
+
+void Profiler::record_zone(const char* name, const sf::Int64 start, const sf::Int64 end)
+{
+    auto& buffer = get_thread_buffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.zones.push_back({name, start, end});
+}
+
+void Profiler::record_counter(const char* name, const double value)
+{
+    auto& buffer = get_thread_buffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.counters.push_back({name, value});
+}
+
+void Profiler::set_tracing(const bool tracing)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    tracing_ = tracing;
+}
+
+Profiler::SummaryRow& Profiler::get_summary_row(const char* name, const bool is_counter)
+{
+    for(auto& row : summary_)
+        if(row.is_counter == is_counter && std::strcmp(row.name, name) == 0)
+            return row;
+    summary_.push_back({name, std::vector<double>(frame_durations_.size(), 0.0), is_counter});
+    return summary_.back();
+}
+
+void Profiler::end_frame()
+{
+    const sf::Int64 frame_end = now();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Open a new column for this tick in every row, dropping the oldest once full.
+    const bool window_full = frame_durations_.size() == ProfilerSettings::summary_frames;
+    const auto push_frame = [window_full](std::vector<double>& totals, const double value)
+    {
+        if(window_full)
+            totals.erase(totals.begin());
+        totals.push_back(value);
+    };
+    push_frame(frame_durations_, static_cast<double>(frame_end - frame_start_) * 1e-6);
+    for(auto& row : summary_)
+        push_frame(row.frame_totals, 0.0);
+
+    for(const auto& thread : threads_)
+    {
+        std::lock_guard<std::mutex> thread_lock(thread->mutex);
+        for(const auto& zone : thread->zones)
+        {
+            get_summary_row(zone.name, false).frame_totals.back() += static_cast<double>(zone.end - zone.start) * 1e-6;
+            if(tracing_ && trace_.size() < ProfilerSettings::max_trace_events)
+                trace_.push_back({zone.name, zone.start, zone.end, 0.0, thread->thread_id, false});
+        }
+        for(const auto& counter : thread->counters)
+            get_summary_row(counter.name, true).frame_totals.back() += counter.value;
+        thread->zones.clear();
+        thread->counters.clear();
+    }
+
+    // Counters go into the trace once per tick, as that tick's totals.
+    if(tracing_)
+        for(const auto& row : summary_)
+            if(row.is_counter && trace_.size() < ProfilerSettings::max_trace_events)
+                trace_.push_back({row.name, frame_end, frame_end, row.frame_totals.back(), 0, true});
+    frame_start_ = frame_end;
+}
+
+bool Profiler::write_chrome_trace(const std::string& path) const
+{
+    std::ofstream file(path);
+    if(!file)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    for(size_t i = 0; i < threads_.size(); i++)
+    {
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i
+            << ",\"args\":{\"name\":\"" << (i == 0 ? "main" : "thread " + std::to_string(i)) << "\"}}";
+        first = false;
+    }
+
+    file.precision(3);
+    file << std::fixed;
+    for(const auto& event : trace_)
+    {
+        file << (first ? "" : ",\n");
+        first = false;
+        if(event.is_counter)
+        {
+            file << "{\"name\":\"" << event.name << "\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":"
+                << static_cast<double>(event.start) * 1e-3 << ",\"args\":{\"value\":" << event.value << "}}";
+        }
+        else
+        {
+            file << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread_id
+                << ",\"ts\":" << static_cast<double>(event.start) * 1e-3
+                << ",\"dur\":" << static_cast<double>(event.end - event.start) * 1e-3 << "}";
+        }
+    }
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+}
+
+std::string Profiler::format_summary() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(frame_durations_.empty())
+        return std::string();
+
+    const auto average = [](const std::vector<double>& values)
+    {
+        double sum = 0.0;
+        for(const auto value : values)
+            sum += value;
+        return values.empty() ? 0.0 : sum / static_cast<double>(values.size());
+    };
+    const double frame_average = average(frame_durations_);
+
+    std::vector<const SummaryRow*> zones;
+    for(const auto& row : summary_)
+        if(!row.is_counter)
+            zones.push_back(&row);
+    std::sort(zones.begin(), zones.end(), [&](const SummaryRow* a, const SummaryRow* b)
+    {
+        return average(a->frame_totals) > average(b->frame_totals);
+    });
+
+    std::ostringstream out;
+    out.precision(3);
+    out << std::fixed;
+    out << "tick: " << frame_average << " ms over " << frame_durations_.size() << " ticks\n";
+    for(const auto zone : zones)
+    {
+        const double zone_average = average(zone->frame_totals);
+        out << "  " << zone->name << ": " << zone_average << " ms avg, "
+            << *std::max_element(zone->frame_totals.begin(), zone->frame_totals.end()) << " ms max, "
+            << (frame_average > 0.0 ? 100.0 * zone_average / frame_average : 0.0) << "%\n";
+    }
+    for(const auto& row : summary_)
+        if(row.is_counter)
+            out << "  " << row.name << ": " << average(row.frame_totals) << " per tick\n";
+    return out.str();
+}
+#endif
@@ -0,0 +1,124 @@
+﻿#pragma once
+#include "Common.h"
+
+// Scoped timers and counters for the hot paths. Everything here compiles to nothing unless
+// PROFILER_ENABLED is set to 1 (the EVOLUTIONSIM_PROFILER CMake option), so the macros can
+// stay in the code for good:
+//   PROFILE_SCOPE("name")           times the rest of the enclosing block
+//   PROFILE_COUNTER("name", value)  adds value to this tick's total for name
+//   PROFILE_FRAME_END()             closes the tick, once per tick on the main thread
+// Names must be string literals or otherwise live for the whole run.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 0
+#endif
+
+#if PROFILER_ENABLED
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace ProfilerSettings
+{
+    // Ticks the rolling summary averages over.
+    static constexpr size_t summary_frames = 120;
+    // Trace recording stops once this many events are held, so a forgotten trace can't eat
+    // all memory on a long run.
+    static constexpr size_t max_trace_events = 8 * 1024 * 1024;
+}
+
+class Profiler
+{
+public:
+    static Profiler& get();
+    // Nanoseconds since the profiler started.
+    static sf::Int64 now();
+
+    void record_zone(const char* name, const sf::Int64 start, const sf::Int64 end);
+    void record_counter(const char* name, const double value);
+    void end_frame();
+
+    // Keeps every zone for write_chrome_trace. Off by default; only the summary is kept.
+    void set_tracing(const bool tracing);
+    // Writes the recorded zones and per-tick counters as Chrome trace JSON, which
+    // chrome://tracing and ui.perfetto.dev both open.
+    bool write_chrome_trace(const std::string& path) const;
+    // Average and worst time per zone over the last ProfilerSettings::summary_frames ticks,
+    // slowest first, plus the average per-tick counter values.
+    std::string format_summary() const;
+
+private:
+    struct Zone
+    {
+        const char* name;
+        sf::Int64 start;
+        sf::Int64 end;
+    };
+
+    struct Counter
+    {
+        const char* name;
+        double value;
+    };
+
+    // Written by one thread, read by end_frame; the mutex is only ever contended then.
+    struct ThreadBuffer
+    {
+        std::mutex mutex;
+        sf::Uint32 thread_id;
+        std::vector<Zone> zones;
+        std::vector<Counter> counters;
+    };
+
+    struct TraceEvent
+    {
+        const char* name;
+        sf::Int64 start;
+        sf::Int64 end;
+        double value;
+        sf::Uint32 thread_id;
+        bool is_counter;
+    };
+
+    // Per name totals of the last summary_frames ticks, oldest first.
+    struct SummaryRow
+    {
+        const char* name;
+        std::vector<double> frame_totals;
+        bool is_counter;
+    };
+
+    ThreadBuffer& get_thread_buffer();
+    SummaryRow& get_summary_row(const char* name, const bool is_counter);
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads_;
+    std::vector<TraceEvent> trace_;
+    bool tracing_ = false;
+    std::vector<SummaryRow> summary_;
+    std::vector<double> frame_durations_;
+    sf::Int64 frame_start_ = 0;
+};
+
+// Records the time from construction to the end of the scope as one zone.
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name) : name_(name), start_(Profiler::now()) {}
+    ~ProfileScope() { Profiler::get().record_zone(name_, start_, Profiler::now()); }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+private:
+    const char* name_;
+    sf::Int64 start_;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::get().record_counter(name, static_cast<double>(value))
+#define PROFILE_FRAME_END() Profiler::get().end_frame()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNTER(name, value)
+#define PROFILE_FRAME_END()
+#endif
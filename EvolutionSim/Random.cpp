@@ -0,0 +1,157 @@
+﻿#include "Random.h"
+
+#include <atomic>
+#include <cmath>
+
+static sf::Uint64 split_mix_64(sf::Uint64& state)
+{
+    sf::Uint64 z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static inline sf::Uint32 rotate_left(const sf::Uint32 x, const int k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+RandomEngine::RandomEngine(const sf::Uint64 seed, const sf::Uint64 stream)
+{
+    this->seed(seed, stream);
+}
+
+void RandomEngine::seed(const sf::Uint64 seed, const sf::Uint64 stream)
+{
+    sf::Uint64 stream_mix = stream;
+    sf::Uint64 mix = seed ^ split_mix_64(stream_mix);
+    for(size_t lane = 0; lane < lanes; lane++)
+    {
+        const sf::Uint64 a = split_mix_64(mix);
+        const sf::Uint64 b = split_mix_64(mix);
+        state_[0][lane] = static_cast<sf::Uint32>(a);
+        state_[1][lane] = static_cast<sf::Uint32>(a >> 32);
+        state_[2][lane] = static_cast<sf::Uint32>(b);
+        state_[3][lane] = static_cast<sf::Uint32>(b >> 32);
+    }
+    buffered_ = lanes;
+}
+
+void RandomEngine::step(sf::Uint32* out)
+{
+    for(size_t lane = 0; lane < lanes; lane++)
+    {
+        const sf::Uint32 s0 = state_[0][lane];
+        const sf::Uint32 s1 = state_[1][lane];
+        const sf::Uint32 s2 = state_[2][lane];
+        const sf::Uint32 s3 = state_[3][lane];
+
+        out[lane] = rotate_left(s1 * 5, 7) * 9;
+
+        const sf::Uint32 t = s1 << 9;
+        const sf::Uint32 n2 = s2 ^ s0;
+        const sf::Uint32 n3 = s3 ^ s1;
+        state_[1][lane] = s1 ^ n2;
+        state_[0][lane] = s0 ^ n3;
+        state_[2][lane] = n2 ^ t;
+        state_[3][lane] = rotate_left(n3, 11);
+    }
+}
+
+void RandomEngine::fill_uniform(float* out, const size_t count, const float lo, const float hi)
+{
+    const float range = hi - lo;
+    size_t i = 0;
+    for(; i < count && buffered_ != lanes; i++)
+        out[i] = lo + next_float() * range;
+
+    sf::Uint32 block[lanes];
+    for(; i + lanes <= count; i += lanes)
+    {
+        step(block);
+        for(size_t lane = 0; lane < lanes; lane++)
+            out[i + lane] = lo + to_unit_float(block[lane]) * range;
+    }
+
+    for(; i < count; i++)
+        out[i] = lo + next_float() * range;
+}
+
+void RandomEngine::fill_bernoulli(sf::Uint8* out, const size_t count, const float chance)
+{
+    size_t i = 0;
+    for(; i < count && buffered_ != lanes; i++)
+        out[i] = next_float() < chance ? 1 : 0;
+
+    sf::Uint32 block[lanes];
+    for(; i + lanes <= count; i += lanes)
+    {
+        step(block);
+        for(size_t lane = 0; lane < lanes; lane++)
+            out[i + lane] = to_unit_float(block[lane]) < chance ? 1 : 0;
+    }
+
+    for(; i < count; i++)
+        out[i] = next_float() < chance ? 1 : 0;
+}
+
+size_t RandomEngine::next_geometric(const float chance)
+{
+    if(chance >= 1.0f)
+        return 0;
+    if(chance <= 0.0f)
+        return max_geometric;
+    // Inverse transform: floor(log(u) / log(1 - chance)) for u uniform in (0, 1]. u has 32
+    // bits, which only cuts off gaps rarer than 1 in 2^32.
+    const double u = (static_cast<double>(next()) + 1.0) * (1.0 / 4294967296.0);
+    const double gap = std::floor(std::log(u) / std::log1p(-static_cast<double>(chance)));
+    return gap >= static_cast<double>(max_geometric) ? max_geometric : static_cast<size_t>(gap);
+}
+
+RandomEngine::State RandomEngine::get_state() const
+{
+    State state;
+    for(size_t word = 0; word < 4; word++)
+        for(size_t lane = 0; lane < lanes; lane++)
+            state.lanes[word][lane] = state_[word][lane];
+    for(size_t lane = 0; lane < lanes; lane++)
+        state.buffer[lane] = buffer_[lane];
+    state.buffered = static_cast<sf::Uint32>(buffered_);
+    return state;
+}
+
+void RandomEngine::set_state(const State& state)
+{
+    for(size_t word = 0; word < 4; word++)
+        for(size_t lane = 0; lane < lanes; lane++)
+            state_[word][lane] = state.lanes[word][lane];
+    for(size_t lane = 0; lane < lanes; lane++)
+        buffer_[lane] = state.buffer[lane];
+    buffered_ = state.buffered > lanes ? lanes : state.buffered;
+}
+
+static RandomEngine& get_thread_default_engine()
+{
+    // Threads that never get a simulation engine bound still draw from distinct streams.
+    static std::atomic<sf::Uint64> next_stream{0};
+    thread_local RandomEngine engine(0, next_stream.fetch_add(1) + 1);
+    return engine;
+}
+
+static thread_local RandomEngine* bound_engine = nullptr;
+
+RandomEngine& get_random_engine()
+{
+    return bound_engine ? *bound_engine : get_thread_default_engine();
+}
+
+RandomEngineScope::RandomEngineScope(RandomEngine& engine)
+{
+    previous_ = bound_engine;
+    bound_engine = &engine;
+}
+
+RandomEngineScope::~RandomEngineScope()
+{
+    bound_engine = previous_;
+}
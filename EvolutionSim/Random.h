@@ -0,0 +1,93 @@
+﻿#pragma once
+#include <SFML/System.hpp>
+
+#include <cstddef>
+
+// xoshiro128** run as eight interleaved lanes. Each step advances all lanes at once, which
+// compilers turn into plain vector code, and the eight results are handed out one by one
+// by next(). The bulk fills consume whole steps directly.
+class RandomEngine
+{
+public:
+    static constexpr size_t lanes = 8;
+
+    explicit RandomEngine(const sf::Uint64 seed = 1, const sf::Uint64 stream = 0);
+    // Streams with the same seed but different ids are independent of each other.
+    void seed(const sf::Uint64 seed, const sf::Uint64 stream = 0);
+
+    inline sf::Uint32 next()
+    {
+        if(buffered_ == lanes)
+        {
+            step(buffer_);
+            buffered_ = 0;
+        }
+        return buffer_[buffered_++];
+    }
+
+    // [0, 1) with 24 bits of precision.
+    inline float next_float() { return to_unit_float(next()); }
+
+    void fill_uniform(float* out, const size_t count, const float lo, const float hi);
+    // out[i] is 1 with probability chance and 0 otherwise.
+    void fill_bernoulli(sf::Uint8* out, const size_t count, const float chance);
+    // How many draws of a chance-per-draw event fail before the next one succeeds. Walking a
+    // sequence by these gaps gives the same hits as testing every position, but costs one
+    // number per hit instead of one per position. Gaps are capped at max_geometric.
+    size_t next_geometric(const float chance);
+    static constexpr size_t max_geometric = 0xFFFFFFFFu;
+
+    static inline float to_unit_float(const sf::Uint32 x)
+    {
+        return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // Raw state, for checkpoints.
+    struct State
+    {
+        sf::Uint32 lanes[4][RandomEngine::lanes];
+        sf::Uint32 buffer[RandomEngine::lanes];
+        sf::Uint32 buffered;
+    };
+    State get_state() const;
+    void set_state(const State& state);
+
+private:
+    void step(sf::Uint32* out);
+
+    sf::Uint32 state_[4][lanes];
+    sf::Uint32 buffer_[lanes];
+    size_t buffered_ = lanes;
+};
+
+// Calls hit(i), in increasing order, for every i in [0, count) that comes up when each one
+// is picked independently with the given chance.
+template <typename F>
+void for_each_bernoulli_hit(RandomEngine& engine, const size_t count, const float chance, F&& hit)
+{
+    size_t i = 0;
+    while(i < count)
+    {
+        const size_t gap = engine.next_geometric(chance);
+        if(gap >= count - i)
+            return;
+        i += gap;
+        hit(i);
+        i++;
+    }
+}
+
+// Engine used by random_int/random_float/random_chance on the calling thread. Every thread
+// starts with its own stream; a simulation binds its seeded engine while it ticks.
+RandomEngine& get_random_engine();
+
+class RandomEngineScope
+{
+public:
+    explicit RandomEngineScope(RandomEngine& engine);
+    ~RandomEngineScope();
+    RandomEngineScope(const RandomEngineScope&) = delete;
+    RandomEngineScope& operator=(const RandomEngineScope&) = delete;
+private:
+    RandomEngine* previous_;
+};
@@ -0,0 +1,78 @@
+﻿#include "ShapeBatch.h"
+
+ShapeBatch::ShapeBatch()
+    : vertices_(sf::Triangles)
+{
+    unit_circles_.resize(ShapeBatchSettings::max_circle_segments + 1);
+    for(size_t n = ShapeBatchSettings::min_circle_segments; n <= ShapeBatchSettings::max_circle_segments; n++)
+    {
+        auto& corners = unit_circles_[n];
+        corners.resize(n);
+        for(size_t i = 0; i < n; i++)
+        {
+            const float angle = 2.0f * PI_F * static_cast<float>(i) / static_cast<float>(n);
+            corners[i] = {std::cos(angle), std::sin(angle)};
+        }
+    }
+}
+
+void ShapeBatch::clear()
+{
+    // Keeps the vertex storage, so a steady scene stops allocating after the first frames.
+    vertices_.clear();
+}
+
+size_t ShapeBatch::get_circle_segments(const float radius) const
+{
+    const float segments = radius * pixels_per_unit_ * segments_per_pixel_;
+    if(segments <= static_cast<float>(ShapeBatchSettings::min_circle_segments))
+        return ShapeBatchSettings::min_circle_segments;
+    if(segments >= static_cast<float>(ShapeBatchSettings::max_circle_segments))
+        return ShapeBatchSettings::max_circle_segments;
+    return static_cast<size_t>(segments);
+}
+
+void ShapeBatch::add_circle(const sf::Vector2f& center, const float radius, const sf::Color& fill,
+    const sf::Color& outline, const float outline_thickness)
+{
+    if(radius <= 0.0f)
+        return;
+
+    const auto& corners = unit_circles_[get_circle_segments(radius)];
+    const float inner_radius = std::max(0.0f, radius - outline_thickness);
+    const size_t n = corners.size();
+    for(size_t i = 0; i < n; i++)
+    {
+        const sf::Vector2f& a = corners[i];
+        const sf::Vector2f& b = corners[i + 1 == n ? 0 : i + 1];
+        const sf::Vector2f inner_a = center + a * inner_radius;
+        const sf::Vector2f inner_b = center + b * inner_radius;
+        const sf::Vector2f outer_a = center + a * radius;
+        const sf::Vector2f outer_b = center + b * radius;
+
+        add_triangle(center, inner_a, inner_b, fill);
+        add_triangle(inner_a, outer_a, outer_b, outline);
+        add_triangle(inner_a, outer_b, inner_b, outline);
+    }
+}
+
+void ShapeBatch::add_rectangle(const sf::Vector2f& center, const sf::Vector2f& size, const float angle_deg,
+    const sf::Color& color)
+{
+    const float angle = angle_deg * PI_F / 180.0f;
+    const sf::Vector2f along = sf::Vector2f(std::cos(angle), std::sin(angle)) * (size.x / 2.0f);
+    const sf::Vector2f across = sf::Vector2f(-std::sin(angle), std::cos(angle)) * (size.y / 2.0f);
+
+    const sf::Vector2f a = center - along - across;
+    const sf::Vector2f b = center + along - across;
+    const sf::Vector2f c = center + along + across;
+    const sf::Vector2f d = center - along + across;
+    add_triangle(a, b, c, color);
+    add_triangle(a, c, d, color);
+}
+
+void ShapeBatch::draw(sf::RenderTarget& target) const
+{
+    if(vertices_.getVertexCount() != 0)
+        target.draw(vertices_);
+}
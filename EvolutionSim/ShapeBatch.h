@@ -0,0 +1,56 @@
+﻿#pragma once
+#include <SFML/Graphics.hpp>
+#include "Common.h"
+
+#define DRAW_RESOLUTION 32
+
+namespace ShapeBatchSettings
+{
+    // Circles get this many segments per pixel of on-screen radius, within the bounds below.
+    static constexpr float default_segments_per_pixel = 1.5f;
+    static constexpr size_t min_circle_segments = 6;
+    static constexpr size_t max_circle_segments = DRAW_RESOLUTION;
+}
+
+// Collects a frame's worth of simple shapes as triangles in one vertex array, so the whole
+// batch goes out in a single draw call. Circles are tessellated from precomputed unit
+// circles, with fewer segments the smaller they end up on screen.
+class ShapeBatch
+{
+public:
+    ShapeBatch();
+
+    void clear();
+    // A filled circle with an outline ring drawn inside its radius, like an sf::CircleShape
+    // with a negative outline thickness.
+    void add_circle(const sf::Vector2f& center, const float radius, const sf::Color& fill,
+        const sf::Color& outline, const float outline_thickness);
+    // A size.x by size.y rectangle centred on center, turned by angle_deg.
+    void add_rectangle(const sf::Vector2f& center, const sf::Vector2f& size, const float angle_deg,
+        const sf::Color& color);
+    void draw(sf::RenderTarget& target) const;
+
+    // World units to pixels, for picking the level of detail. Set once per frame from the view.
+    inline void set_pixels_per_unit(const float pixels_per_unit) { pixels_per_unit_ = pixels_per_unit; }
+    inline void set_segments_per_pixel(const float segments_per_pixel) { segments_per_pixel_ = segments_per_pixel; }
+    inline size_t get_vertex_count() const { return vertices_.getVertexCount(); }
+
+private:
+    size_t get_circle_segments(const float radius) const;
+    inline void add_triangle(const sf::Vector2f& a, const sf::Vector2f& b, const sf::Vector2f& c,
+        const sf::Color& color);
+
+    sf::VertexArray vertices_;
+    // unit_circles_[n] holds the n corners of a unit circle, for every segment count in use.
+    std::vector<std::vector<sf::Vector2f>> unit_circles_;
+    float pixels_per_unit_ = 1.0f;
+    float segments_per_pixel_ = ShapeBatchSettings::default_segments_per_pixel;
+};
+
+void ShapeBatch::add_triangle(const sf::Vector2f& a, const sf::Vector2f& b, const sf::Vector2f& c,
+    const sf::Color& color)
+{
+    vertices_.append(sf::Vertex(a, color));
+    vertices_.append(sf::Vertex(b, color));
+    vertices_.append(sf::Vertex(c, color));
+}
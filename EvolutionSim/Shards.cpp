@@ -0,0 +1,296 @@
+﻿#include "Shards.h"
+
+#include "Profiler.h"
+
+#include <chrono>
+
+#ifndef _WIN32
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#endif
+
+ShardRunner::ShardRunner(const size_t shard_count, const unsigned int seed, const size_t threads_per_shard,
+    const size_t plant_count, const size_t creature_count)
+    : shard_count_(clamp<size_t>(shard_count, 1, get_max_shard_count())), seed_(seed), threads_per_shard_(threads_per_shard),
+    plant_count_(plant_count), creature_count_(creature_count)
+{
+}
+
+size_t ShardRunner::get_max_shard_count()
+{
+    return std::max<size_t>(1, static_cast<size_t>(world_extent.x / ShardSettings::halo));
+}
+
+#ifdef _WIN32
+bool ShardRunner::run(const size_t, const float)
+{
+    std::cerr << "sharding needs fork and POSIX shared memory" << std::endl;
+    return false;
+}
+#else
+// The shared memory holds this, then a report per shard, then two mailboxes per direction
+// per shard, one for even and one for odd ticks. A shard writes this tick's mailbox while its
+// neighbours may still be reading last tick's, and nobody can be two ticks behind because of
+// the barrier, so no mailbox is ever written and read at once.
+struct SharedState
+{
+    pthread_barrier_t barrier;
+    std::atomic<sf::Uint32> failed{0};
+};
+
+static constexpr size_t cache_line = 64;
+
+static size_t round_up(const size_t bytes)
+{
+    return (bytes + cache_line - 1) / cache_line * cache_line;
+}
+
+class SharedLayout
+{
+public:
+    SharedLayout(void* memory, const size_t shard_count)
+        : base_(static_cast<char*>(memory)), shard_count_(shard_count) {}
+
+    static size_t get_size(const size_t shard_count)
+    {
+        return get_mailboxes_offset(shard_count) + shard_count * 4 * get_mailbox_size();
+    }
+
+    inline SharedState& get_state() const { return *reinterpret_cast<SharedState*>(base_); }
+    inline ShardReport& get_report(const size_t k) const
+    {
+        return reinterpret_cast<ShardReport*>(base_ + round_up(sizeof(SharedState)))[k];
+    }
+    // How many creatures shard k owned when the tick before an even or odd one ended, kept
+    // apart by parity like the mailboxes.
+    inline sf::Uint64& get_creature_count(const size_t k, const size_t parity) const
+    {
+        return reinterpret_cast<sf::Uint64*>(base_ + get_creature_counts_offset(shard_count_))[k * 2 + parity];
+    }
+    // Where shard k leaves its border for the neighbour on side 0 (low) or 1 (high). The size
+    // comes first, then the bytes.
+    inline char* get_mailbox(const size_t k, const size_t side, const size_t parity) const
+    {
+        return base_ + get_mailboxes_offset(shard_count_) + ((k * 2 + side) * 2 + parity) * get_mailbox_size();
+    }
+
+private:
+    static size_t get_creature_counts_offset(const size_t shard_count)
+    {
+        return round_up(sizeof(SharedState)) + round_up(shard_count * sizeof(ShardReport));
+    }
+    static size_t get_mailboxes_offset(const size_t shard_count)
+    {
+        return get_creature_counts_offset(shard_count) + round_up(shard_count * 2 * sizeof(sf::Uint64));
+    }
+    static size_t get_mailbox_size() { return cache_line + ShardSettings::mailbox_bytes; }
+
+    char* base_;
+    size_t shard_count_;
+};
+
+static bool post(char* mailbox, const std::vector<char>& bytes)
+{
+    if(bytes.size() > ShardSettings::mailbox_bytes)
+        return false;
+    const sf::Uint64 size = bytes.size();
+    std::memcpy(mailbox, &size, sizeof(size));
+    std::memcpy(mailbox + cache_line, bytes.data(), bytes.size());
+    return true;
+}
+
+static bool collect(const char* mailbox, Simulation& simulation)
+{
+    sf::Uint64 size;
+    std::memcpy(&size, mailbox, sizeof(size));
+    if(size > ShardSettings::mailbox_bytes)
+        return false;
+    BinaryReader in(mailbox + cache_line, static_cast<size_t>(size));
+    return simulation.read_border(in);
+}
+
+// Shard k's share of count things, so the shares add up to count exactly.
+static size_t get_share(const size_t count, const size_t k, const size_t shard_count)
+{
+    return count * (k + 1) / shard_count - count * k / shard_count;
+}
+
+// Runs in the shard's own process.
+static bool run_shard(const SharedLayout& shared, const size_t k, const size_t shard_count, const unsigned int seed,
+    const size_t thread_count, const size_t plant_count, const size_t creature_count, const size_t ticks,
+    const float dt)
+{
+    using clock = std::chrono::steady_clock;
+    const float width = world_extent.x / static_cast<float>(shard_count);
+    const float left = static_cast<float>(k) * width;
+    const float right = k + 1 == shard_count ? world_extent.x : static_cast<float>(k + 1) * width;
+    Simulation simulation(seed, thread_count, get_share(plant_count, k, shard_count),
+        get_share(creature_count, k, shard_count), FoodModel::Plants, left, right);
+
+    SharedState& state = shared.get_state();
+    ShardReport report;
+    BinaryWriter low;
+    BinaryWriter high;
+    const auto run_start = clock::now();
+    for(size_t tick = 0; tick < ticks; tick++)
+    {
+        const auto exchange_start = clock::now();
+        const size_t parity = tick % 2;
+        low.get_bytes().clear();
+        high.get_bytes().clear();
+        // Counted before anyone leaves, so creatures on their way to a neighbour count once.
+        shared.get_creature_count(k, parity) = simulation.get_creatures().get_count();
+        simulation.write_border(ShardSettings::halo, low, high);
+        const bool posted = (k == 0 || post(shared.get_mailbox(k, 0, parity), low.get_bytes())) &&
+            (k + 1 == shard_count || post(shared.get_mailbox(k, 1, parity), high.get_bytes()));
+        if(!posted)
+            state.failed.store(1);
+
+        // Everyone stops at the same barrier once anyone has failed.
+        pthread_barrier_wait(&state.barrier);
+        if(state.failed.load())
+            break;
+
+        // The neighbour below sent its high side and the one above its low side.
+        const bool collected = (k == 0 || collect(shared.get_mailbox(k - 1, 1, parity), simulation)) &&
+            (k + 1 == shard_count || collect(shared.get_mailbox(k + 1, 0, parity), simulation));
+        report.exchange_seconds += std::chrono::duration<double>(clock::now() - exchange_start).count();
+        if(!collected)
+        {
+            state.failed.store(1);
+            continue;
+        }
+        size_t world_creature_count = 0;
+        for(size_t other = 0; other < shard_count; other++)
+            world_creature_count += static_cast<size_t>(shared.get_creature_count(other, parity));
+        simulation.set_world_creature_count(world_creature_count);
+
+        simulation.tick(dt);
+        PROFILE_FRAME_END();
+    }
+    report.seconds = std::chrono::duration<double>(clock::now() - run_start).count();
+    report.creatures = simulation.get_creatures().get_count();
+    report.plants = simulation.get_plants().get_count();
+    report.departures = simulation.get_border_stats().departures;
+    report.arrivals = simulation.get_border_stats().arrivals;
+    report.ghosts = simulation.get_border_stats().ghosts;
+    shared.get_report(k) = report;
+    return state.failed.load() == 0;
+}
+
+bool ShardRunner::run(const size_t ticks, const float dt)
+{
+    const size_t bytes = SharedLayout::get_size(shard_count_);
+    const std::string name = "/evolutionsim-shards-" + std::to_string(getpid());
+    const int file = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(file < 0)
+        return false;
+    // The name is only needed until the memory is mapped; the children inherit the mapping,
+    // and nothing is left behind however the run ends.
+    void* memory = ftruncate(file, static_cast<off_t>(bytes)) == 0 ?
+        mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED;
+    close(file);
+    shm_unlink(name.c_str());
+    if(memory == MAP_FAILED)
+        return false;
+
+    const SharedLayout shared(memory, shard_count_);
+    SharedState& state = *new(memory) SharedState();
+    pthread_barrierattr_t barrier_attributes;
+    pthread_barrierattr_init(&barrier_attributes);
+    pthread_barrierattr_setpshared(&barrier_attributes, PTHREAD_PROCESS_SHARED);
+    const bool has_barrier = pthread_barrier_init(&state.barrier, &barrier_attributes,
+        static_cast<unsigned int>(shard_count_)) == 0;
+    pthread_barrierattr_destroy(&barrier_attributes);
+
+    bool ok = has_barrier;
+    std::vector<pid_t> children;
+    for(size_t k = 0; ok && k < shard_count_; k++)
+    {
+        const pid_t child = fork();
+        if(child == 0)
+        {
+#ifdef __linux__
+            // Nobody would be left to stop the shards if the parent died first.
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if(getppid() == 1)
+                _exit(1);
+#endif
+            // _exit skips the parent's exit handlers and stream flushes, which aren't ours.
+            const bool shard_ok = run_shard(shared, k, shard_count_, get_seed(k), threads_per_shard_,
+                plant_count_, creature_count_, ticks, dt);
+            _exit(shard_ok ? 0 : 1);
+        }
+        if(child < 0)
+            ok = false;
+        else
+            children.push_back(child);
+    }
+
+    // Shards wait on each other every tick, so once one is gone the rest never finish.
+    const auto stop_children = [&children]
+    {
+        for(const pid_t child : children)
+            if(child != 0)
+                kill(child, SIGKILL);
+    };
+    if(!ok)
+        stop_children();
+    // Only the shards are reaped: other children of the process belong to whoever made them.
+    size_t running = children.size();
+    while(running > 0)
+    {
+        bool reaped = false;
+        for(pid_t& child : children)
+        {
+            if(child == 0)
+                continue;
+            int status = 0;
+            const pid_t result = waitpid(child, &status, WNOHANG);
+            if(result == 0 || (result < 0 && errno == EINTR))
+                continue;
+            // Gone without a status, e.g. reaped elsewhere, counts as failed.
+            const bool child_ok = result == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            child = 0;
+            running--;
+            reaped = true;
+            if(!child_ok)
+            {
+                if(ok)
+                    stop_children();
+                ok = false;
+            }
+        }
+        if(!reaped && running > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(ShardSettings::reap_poll_milliseconds));
+    }
+
+    ok = ok && running == 0 && state.failed.load() == 0;
+    if(ok)
+    {
+        reports_.resize(shard_count_);
+        for(size_t k = 0; k < shard_count_; k++)
+            reports_[k] = shared.get_report(k);
+    }
+    // Destroying waits for every shard to have left the barrier, which killed ones never do.
+    // Unmapping frees it all the same.
+    if(ok)
+        pthread_barrier_destroy(&state.barrier);
+    state.~SharedState();
+    munmap(memory, bytes);
+    return ok;
+}
+#endif
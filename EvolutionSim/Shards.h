@@ -0,0 +1,69 @@
+﻿#pragma once
+#include "Simulation.h"
+
+// One world too big for one process, split into vertical strips of equal width, each owned
+// by a process of its own on the same machine. Every tick the shards swap borders with their
+// neighbours through POSIX shared memory: creatures that crossed over move for good, brain and
+// all, and whatever lies near an edge is mirrored into the neighbour as read-only ghosts, so
+// creatures there still see across it (see Simulation::write_border).
+//
+// The shards tick in lock step behind a process-shared barrier, and every shard reads the
+// same borders whatever the timing, so a run is reproducible. A single shard is the plain
+// world. Only ghosts are seen across edges: food and fights stay within a shard.
+//
+// Needs fork and POSIX shared memory; elsewhere run just fails.
+namespace ShardSettings
+{
+    // How far into a neighbour a shard sees. Sensing reaches vision_distance, or the sizes of
+    // both creatures when they overlap, and sizes rarely evolve anywhere near this.
+    static constexpr float halo = 2.0f * CreatureStore::default_vision_distance;
+    // What one shard can send one neighbour in a tick. A border that doesn't fit ends the run.
+    static constexpr size_t mailbox_bytes = 16 * 1024 * 1024;
+    // How often the parent looks for shards that have ended. It only waits on its own shards,
+    // and one that fails has to be seen while the others are still blocked on it.
+    static constexpr int reap_poll_milliseconds = 1;
+}
+
+// Filled in by each shard process when its run ends.
+struct ShardReport
+{
+    // Wall time of the tick loop, and how much of it went to the border exchange, which
+    // includes waiting for the slowest shard.
+    double seconds = 0.0;
+    double exchange_seconds = 0.0;
+    sf::Uint64 creatures = 0;
+    sf::Uint64 plants = 0;
+    sf::Uint64 departures = 0;
+    sf::Uint64 arrivals = 0;
+    sf::Uint64 ghosts = 0;
+};
+
+class ShardRunner
+{
+public:
+    // Shard k owns the k-th strip from the left and is seeded with seed + k. The plants and
+    // creatures are shared out over the strips; threads_per_shard sizes each shard's JobPool.
+    // shard_count is clamped to get_max_shard_count.
+    ShardRunner(const size_t shard_count, const unsigned int seed, const size_t threads_per_shard,
+        const size_t plant_count, const size_t creature_count);
+
+    // Starts a process per shard, ticks every one of them ticks times by dt and waits for them
+    // all. False if the processes or their shared memory couldn't be set up, a border didn't
+    // fit its mailbox or a shard died; the reports are only filled in on success.
+    bool run(const size_t ticks, const float dt);
+
+    inline size_t get_shard_count() const { return shard_count_; }
+    inline const ShardReport& get_report(const size_t k) const { return reports_[k]; }
+    inline unsigned int get_seed(const size_t k) const { return seed_ + static_cast<unsigned int>(k); }
+    // No strip may be narrower than the halo, or creatures near a border couldn't see what
+    // lies two strips away.
+    static size_t get_max_shard_count();
+
+private:
+    size_t shard_count_;
+    unsigned int seed_;
+    size_t threads_per_shard_;
+    size_t plant_count_;
+    size_t creature_count_;
+    std::vector<ShardReport> reports_;
+};
@@ -0,0 +1,79 @@
+﻿#include "Simd.h"
+
+#if SIMD_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static SimdLevel detect_simd_level()
+{
+#if SIMD_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    
+    __cpuid(info, 1);
+    const bool has_sse2 = (info[3] & (1 << 26)) != 0;
+    const bool has_osxsave = (info[2] & (1 << 27)) != 0;
+    const bool has_avx = (info[2] & (1 << 28)) != 0;
+    if(!has_sse2)
+        return SimdLevel::Scalar;
+
+    // The OS has to save the upper halves of the YMM registers as well.
+    if(max_leaf < 7 || !has_osxsave || !has_avx || (_xgetbv(0) & 0x6) != 0x6)
+        return SimdLevel::Sse;
+    
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0 ? SimdLevel::Avx2 : SimdLevel::Sse;
+#elif SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return SimdLevel::Avx2;
+    if(__builtin_cpu_supports("sse2"))
+        return SimdLevel::Sse;
+    return SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+static SimdLevel supported_simd_level = detect_simd_level();
+static SimdLevel current_simd_level = supported_simd_level;
+
+SimdLevel get_supported_simd_level()
+{
+    return supported_simd_level;
+}
+
+SimdLevel get_simd_level()
+{
+    return current_simd_level;
+}
+
+void set_simd_level(const SimdLevel level)
+{
+    current_simd_level = std::min(level, supported_simd_level);
+}
+
+const char* get_simd_level_name(const SimdLevel level)
+{
+    switch(level)
+    {
+    case SimdLevel::Scalar: return "scalar";
+    case SimdLevel::Sse: return "sse";
+    case SimdLevel::Avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool parse_simd_level(const std::string& name, SimdLevel& out)
+{
+    for(const auto level : {SimdLevel::Scalar, SimdLevel::Sse, SimdLevel::Avx2})
+    {
+        if(name == get_simd_level_name(level))
+        {
+            out = level;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,37 @@
+﻿#pragma once
+#include "Common.h"
+
+#include <string>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+// GCC and Clang only emit vector instructions inside functions that ask for them, so the
+// wider kernels can live next to the scalar ones and be picked at runtime.
+#if SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET_SSE __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_SSE
+#define SIMD_TARGET_AVX2
+#endif
+
+enum class SimdLevel : sf::Uint8  // NOLINT(performance-enum-size)
+{
+    Scalar,
+    Sse,
+    Avx2
+};
+
+// What the CPU can run, detected once.
+SimdLevel get_supported_simd_level();
+// What the kernels currently use. Defaults to the supported level.
+SimdLevel get_simd_level();
+// Requests a level; anything the CPU cannot run is clamped down to the supported level.
+void set_simd_level(const SimdLevel level);
+const char* get_simd_level_name(const SimdLevel level);
+bool parse_simd_level(const std::string& name, SimdLevel& out);
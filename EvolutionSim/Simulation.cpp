@@ -0,0 +1,432 @@
+﻿#include "Simulation.h"
+
+#include "Profiler.h"
+
+const char* get_food_model_name(const FoodModel model)
+{
+    switch(model)
+    {
+    case FoodModel::Plants: return "plants";
+    case FoodModel::Field: return "field";
+    }
+    return "unknown";
+}
+
+bool parse_food_model(const std::string& name, FoodModel& out)
+{
+    for(const auto model : {FoodModel::Plants, FoodModel::Field})
+        if(name == get_food_model_name(model))
+        {
+            out = model;
+            return true;
+        }
+    return false;
+}
+
+// Copies of a neighbour's border entities, as write_border sends them.
+struct PlantGhost
+{
+    sf::Vector2f position;
+    float size;
+    Gene gene;
+};
+
+struct CreatureGhost
+{
+    sf::Vector2f position;
+    float size;
+    Gene gene;
+    Gene diet;
+};
+
+Simulation::Simulation(const unsigned int seed, const size_t thread_count,
+    const size_t plant_count, const size_t creature_count, const FoodModel food_model,
+    const float region_left, const float region_right)
+    : jobs_(thread_count), random_(seed), region_left_(region_left), region_right_(region_right),
+    region_share_((region_right - region_left) / world_extent.x)
+{
+    RandomEngineScope random_scope(random_);
+
+    time_until_plant_spawn_ = SimulationSettings::plant_spawn_interval;
+
+    if(food_model == FoodModel::Field)
+        food_field_.create(world_extent, FoodFieldSettings::cell_size, SimulationSettings::initial_food_fill);
+    else
+        for(size_t i = 0; i < plant_count; i++)
+            plants_.spawn(region_left_, region_right_);
+
+    for(size_t i = 0; i < creature_count; i++)
+        creatures_.spawn_random(time_, region_left_, region_right_);
+}
+
+void Simulation::tick(const float dt)
+{
+    PROFILE_SCOPE("simulation tick");
+    RandomEngineScope random_scope(random_);
+
+    new_plants_.clear();
+    {
+        PROFILE_SCOPE("spawn");
+        const bool extinct = region_share_ >= 1.0f ?
+            creatures_.get_count() == ghost_creature_count_ : world_creature_count_ == 0;
+        if(extinct)
+        {
+            const auto count = static_cast<size_t>(
+                std::lround(static_cast<float>(SimulationSettings::initial_creature_count) * region_share_));
+            for(size_t i = 0; i < count; i++)
+                creatures_.spawn_random(time_, region_left_, region_right_);
+        }
+
+        if(get_food_model() == FoodModel::Plants)
+        {
+            time_until_plant_spawn_ -= dt;
+            if(time_until_plant_spawn_ <= 0)
+            {
+                time_until_plant_spawn_ += SimulationSettings::plant_spawn_interval;
+                // A whole world doesn't draw for this, so it stays as it was before sharding.
+                if(region_share_ >= 1.0f || random_chance(region_share_))
+                    new_plants_.push_back(plants_.spawn(region_left_, region_right_));
+            }
+        }
+    }
+
+    {
+        PROFILE_SCOPE("grid rebuild");
+        plant_grid_.rebuild(plants_, CreatureStore::default_vision_distance);
+        creature_grid_.rebuild(creatures_, CreatureStore::default_vision_distance);
+    }
+
+    if(sleeping_chunks_ || !chunks_.is_empty())
+    {
+        PROFILE_SCOPE("chunks");
+        update_chunks();
+    }
+
+    // Everyone whose turn it is senses the same world and thinks in one batch before anyone
+    // acts. Creatures born while interacting join in next tick. Nothing has died yet this
+    // tick, so the dead skipped until interact are only ever ghosts. With chunks, only the
+    // plants of the awake ones are visited.
+    const size_t plant_slots = chunks_.is_empty() ? plants_.get_capacity() : awake_plants_.size();
+    const size_t creature_slots = creatures_.get_capacity();
+    tick_think_interval_ = get_think_interval();
+    {
+        PROFILE_SCOPE("sense");
+        brains_.reset(creature_slots);
+        jobs_.parallel_for(plant_slots, SimulationSettings::act_grain, [this](const size_t begin, const size_t end)
+        {
+            PROFILE_SCOPE("sense plants job");
+            for(size_t k = begin; k < end; k++)
+            {
+                const size_t i = chunks_.is_empty() ? k : awake_plants_[k];
+                if(plants_.is_used(i) && plants_.alive[i])
+                    plants_.sense(i, plant_grid_);
+            }
+        });
+        jobs_.parallel_for(creature_slots, SimulationSettings::sense_grain, [this](const size_t begin, const size_t end)
+        {
+            PROFILE_SCOPE("sense creatures job");
+            for(size_t i = begin; i < end; i++)
+            {
+                if(!creatures_.is_used(i) || !creatures_.alive[i])
+                    continue;
+                if(!creatures_.has_decision[i] || (tick_count_ + i) % tick_think_interval_ == 0)
+                    creatures_.sense(i, plants_, plant_grid_, creature_grid_, food_field_, brains_);
+                else
+                    creatures_.keep_decision(i, plants_);
+            }
+        });
+    }
+
+    {
+        PROFILE_SCOPE("inference");
+        brains_.run(jobs_);
+    }
+
+    {
+        PROFILE_SCOPE("movement");
+        jobs_.parallel_for(plant_slots, SimulationSettings::act_grain, [this, dt](const size_t begin, const size_t end)
+        {
+            PROFILE_SCOPE("act plants job");
+            for(size_t k = begin; k < end; k++)
+            {
+                const size_t i = chunks_.is_empty() ? k : awake_plants_[k];
+                if(plants_.is_used(i) && plants_.alive[i])
+                    plants_.act(i, dt);
+            }
+        });
+        jobs_.parallel_for(creature_slots, SimulationSettings::act_grain, [this, dt](const size_t begin, const size_t end)
+        {
+            PROFILE_SCOPE("act creatures job");
+            for(size_t i = begin; i < end; i++)
+                if(creatures_.is_used(i) && creatures_.alive[i])
+                    creatures_.act(i, dt, brains_);
+        });
+    }
+
+    {
+        PROFILE_SCOPE("food growth");
+        food_field_.grow(dt, jobs_);
+    }
+
+    {
+        PROFILE_SCOPE("interact");
+        // Whoever hasn't decided anything yet was just born.
+        for(size_t i = 0; i < creature_slots; i++)
+            if(creatures_.is_used(i) && creatures_.has_decision[i])
+                creatures_.interact(i, dt, time_, plants_, food_field_);
+    }
+
+    {
+        PROFILE_SCOPE("remove dead");
+        plants_.remove_dead();
+        if(!chunks_.is_empty())
+            remove_dead_from_chunks();
+        creatures_.remove_dead();
+        ghost_creature_count_ = 0;
+    }
+    PROFILE_COUNTER("plants", plants_.get_count());
+    PROFILE_COUNTER("creatures", creatures_.get_count());
+    PROFILE_COUNTER("think interval", tick_think_interval_);
+    PROFILE_COUNTER("awake plants", chunks_.is_empty() ? plants_.get_count() : awake_plants_.size());
+
+    time_ += dt;
+    tick_count_++;
+}
+
+void Simulation::update_chunks()
+{
+    const bool can_sleep = sleeping_chunks_ && region_share_ >= 1.0f && get_food_model() == FoodModel::Plants;
+    const bool created = chunks_.is_empty();
+    if(created)
+    {
+        if(!can_sleep)
+            return;
+        chunks_.create(world_extent, ChunkSettings::chunk_size);
+        for(size_t i = 0; i < plants_.get_capacity(); i++)
+            if(plants_.is_used(i))
+                chunks_.add_plant(chunks_.get_chunk(plants_.position[i]), static_cast<sf::Uint32>(i));
+    }
+
+    // A creature senses as far as its vision, or as far as it could overlap a plant, and
+    // only eats what it has sensed.
+    chunks_.clear_wanted();
+    if(!can_sleep)
+        chunks_.want_all();
+    for(size_t i = 0; can_sleep && i < creatures_.get_capacity(); i++)
+        if(creatures_.is_used(i) && creatures_.alive[i])
+            chunks_.want(creatures_.position[i],
+                std::max(creatures_.vision_distance[i], creatures_.size[i] + plant_grid_.get_max_size()));
+    for(const sf::Uint32 plant : new_plants_)
+        chunks_.want_chunk(chunks_.get_chunk(plants_.position[plant]));
+
+    bool caught_up = false;
+    for(size_t chunk = 0; chunk < chunks_.get_chunk_count(); chunk++)
+    {
+        if(chunks_.is_wanted(chunk) && !chunks_.is_awake(chunk))
+        {
+            if(!chunks_.get_plants(chunk).empty())
+            {
+                plants_.catch_up(chunks_.get_plants(chunk),
+                    static_cast<float>(time_ - chunks_.get_asleep_since(chunk)), plant_grid_, catch_up_scratch_);
+                caught_up = true;
+            }
+            chunks_.wake(chunk);
+        }
+        else if(!chunks_.is_wanted(chunk) && chunks_.is_awake(chunk))
+            chunks_.put_to_sleep(chunk, time_);
+    }
+    // Grown plants may overlap further than the grid allows for.
+    if(caught_up)
+        plant_grid_.rebuild(plants_, CreatureStore::default_vision_distance);
+
+    if(!can_sleep)
+    {
+        chunks_.clear();
+        return;
+    }
+    if(!created)
+        for(const sf::Uint32 plant : new_plants_)
+            chunks_.add_plant(chunks_.get_chunk(plants_.position[plant]), plant);
+    awake_plants_.clear();
+    for(size_t chunk = 0; chunk < chunks_.get_chunk_count(); chunk++)
+        if(chunks_.is_awake(chunk))
+            awake_plants_.insert(awake_plants_.end(), chunks_.get_plants(chunk).begin(), chunks_.get_plants(chunk).end());
+}
+
+void Simulation::remove_dead_from_chunks()
+{
+    for(size_t chunk = 0; chunk < chunks_.get_chunk_count(); chunk++)
+        if(chunks_.is_awake(chunk))
+            chunks_.remove_plants_if(chunk, [this](const sf::Uint32 plant){ return !plants_.is_used(plant); });
+}
+
+void Simulation::set_think_rate(const size_t think_interval, const size_t think_budget)
+{
+    think_interval_ = std::max<size_t>(1, think_interval);
+    think_budget_ = think_budget;
+}
+
+size_t Simulation::get_think_interval() const
+{
+    if(think_budget_ == 0)
+        return think_interval_;
+    return std::max(think_interval_, (creatures_.get_count() + think_budget_ - 1) / think_budget_);
+}
+
+void Simulation::emigrate(const size_t count, std::vector<CreatureGenome>& out)
+{
+    RandomEngineScope random_scope(random_);
+
+    std::vector<sf::Uint32> candidates;
+    candidates.reserve(creatures_.get_count());
+    for(size_t i = 0; i < creatures_.get_capacity(); i++)
+        if(creatures_.is_used(i) && creatures_.alive[i])
+            candidates.push_back(static_cast<sf::Uint32>(i));
+
+    // The first picks of a Fisher-Yates shuffle.
+    const size_t picks = std::min(count, candidates.size());
+    for(size_t k = 0; k < picks; k++)
+    {
+        std::swap(candidates[k], candidates[k + static_cast<size_t>(random_int()) % (candidates.size() - k)]);
+        const size_t i = candidates[k];
+        out.push_back(creatures_.get_genome(i));
+        creatures_.alive[i] = 0;
+    }
+    creatures_.remove_dead();
+}
+
+void Simulation::immigrate(const std::vector<CreatureGenome>& genomes)
+{
+    RandomEngineScope random_scope(random_);
+    for(const auto& genome : genomes)
+        creatures_.spawn_genome(genome, time_);
+}
+
+void Simulation::write_border(const float halo, BinaryWriter& low, BinaryWriter& high)
+{
+    // The world's own edges have no neighbour behind them.
+    const bool has_low = region_left_ > 0.0f;
+    const bool has_high = region_right_ < world_extent.x;
+
+    CreatureStore leavers[2];
+    for(size_t i = 0; i < creatures_.get_capacity(); i++)
+    {
+        if(!creatures_.is_used(i))
+            continue;
+        const float x = creatures_.position[i].x;
+        const bool to_low = has_low && x < region_left_;
+        if(!to_low && !(has_high && x >= region_right_))
+            continue;
+        leavers[to_low ? 0 : 1].spawn_copy(creatures_, i);
+        creatures_.alive[i] = 0;
+        border_stats_.departures++;
+    }
+    creatures_.remove_dead();
+
+    std::vector<PlantGhost> plant_ghosts[2];
+    for(size_t i = 0; i < plants_.get_capacity(); i++)
+    {
+        if(!plants_.is_used(i))
+            continue;
+        const PlantGhost ghost = {plants_.position[i], plants_.size[i], plants_.gene[i]};
+        if(has_low && ghost.position.x < region_left_ + halo)
+            plant_ghosts[0].push_back(ghost);
+        if(has_high && ghost.position.x >= region_right_ - halo)
+            plant_ghosts[1].push_back(ghost);
+    }
+    std::vector<CreatureGhost> creature_ghosts[2];
+    for(size_t i = 0; i < creatures_.get_capacity(); i++)
+    {
+        if(!creatures_.is_used(i))
+            continue;
+        const CreatureGhost ghost = {creatures_.position[i], creatures_.size[i], creatures_.gene[i], creatures_.diet[i]};
+        if(has_low && ghost.position.x < region_left_ + halo)
+            creature_ghosts[0].push_back(ghost);
+        if(has_high && ghost.position.x >= region_right_ - halo)
+            creature_ghosts[1].push_back(ghost);
+    }
+
+    BinaryWriter* out[2] = {&low, &high};
+    for(size_t side = 0; side < 2; side++)
+    {
+        leavers[side].write(*out[side]);
+        out[side]->write_vector(plant_ghosts[side]);
+        out[side]->write_vector(creature_ghosts[side]);
+    }
+}
+
+bool Simulation::read_border(BinaryReader& in)
+{
+    CreatureStore arrivals;
+    std::vector<PlantGhost> plant_ghosts;
+    std::vector<CreatureGhost> creature_ghosts;
+    if(!arrivals.read(in) || !in.read_vector(plant_ghosts) || !in.read_vector(creature_ghosts))
+        return false;
+
+    for(size_t j = 0; j < arrivals.get_capacity(); j++)
+        if(arrivals.is_used(j))
+        {
+            creatures_.spawn_copy(arrivals, j);
+            border_stats_.arrivals++;
+        }
+    for(const auto& ghost : plant_ghosts)
+        plants_.spawn_ghost(ghost.position, ghost.size, ghost.gene);
+    for(const auto& ghost : creature_ghosts)
+        creatures_.spawn_ghost(ghost.position, ghost.size, ghost.gene, ghost.diet);
+    ghost_creature_count_ += creature_ghosts.size();
+    border_stats_.ghosts += plant_ghosts.size() + creature_ghosts.size();
+    return true;
+}
+
+void Simulation::write(BinaryWriter& out) const
+{
+    out.write(tick_count_);
+    out.write(time_);
+    out.write(time_until_plant_spawn_);
+    out.write(world_extent);
+    out.write(random_.get_state());
+    plants_.write(out);
+    food_field_.write(out);
+    chunks_.write(out);
+    creatures_.write(out);
+}
+
+bool Simulation::read(BinaryReader& in)
+{
+    sf::Uint64 tick_count;
+    double time;
+    float time_until_plant_spawn;
+    sf::Vector2f extent;
+    RandomEngine::State random_state;
+    PlantStore plants;
+    FoodField food_field;
+    ChunkMap chunks;
+    CreatureStore creatures;
+    if(!in.read(tick_count) ||
+        !in.read(time) ||
+        !in.read(time_until_plant_spawn) ||
+        !in.read(extent) ||
+        !in.read(random_state) ||
+        !plants.read(in) ||
+        !food_field.read(in) ||
+        !chunks.read(in) ||
+        !creatures.read(in))
+        return false;
+
+    // Positions only make sense in the world they were saved from.
+    if(extent != world_extent)
+        return false;
+
+    tick_count_ = tick_count;
+    time_ = time;
+    time_until_plant_spawn_ = time_until_plant_spawn;
+    random_.set_state(random_state);
+    plants_ = std::move(plants);
+    food_field_ = std::move(food_field);
+    creatures_ = std::move(creatures);
+    chunks_ = std::move(chunks);
+    for(size_t i = 0; !chunks_.is_empty() && i < plants_.get_capacity(); i++)
+        if(plants_.is_used(i))
+            chunks_.add_plant(chunks_.get_chunk(plants_.position[i]), static_cast<sf::Uint32>(i));
+    return true;
+}
@@ -0,0 +1,175 @@
+﻿#pragma once
+#include "Chunks.h"
+#include "Common.h"
+#include "Creature.h"
+#include "FoodField.h"
+#include "JobPool.h"
+#include "SpatialGrid.h"
+
+#include <string>
+
+namespace SimulationSettings
+{
+    static constexpr float plant_spawn_interval = 5.f;
+    static constexpr size_t initial_plant_count = 50;
+    
+    static constexpr size_t initial_creature_count = DEBUG_VALUE_SWITCH(100, 1000);
+
+    // How full the food field's cells start, at most, as a fraction of their capacity.
+    static constexpr float initial_food_fill = 0.5f;
+
+    static constexpr unsigned int default_seed = 1;
+    // Slots per job in the parallel phases.
+    static constexpr size_t sense_grain = 64;
+    static constexpr size_t act_grain = 512;
+
+    // See Simulation::set_think_rate.
+    static constexpr size_t default_think_interval = 1;
+    static constexpr size_t default_think_budget = 0;
+}
+
+// Where plant food comes from: plant entities that spawn, grow and get eaten one by one, or
+// a FoodField of biomass covering the whole world.
+enum class FoodModel : sf::Uint8  // NOLINT(performance-enum-size)
+{
+    Plants,
+    Field
+};
+
+const char* get_food_model_name(const FoodModel model);
+bool parse_food_model(const std::string& name, FoodModel& out);
+
+// Creatures and copies that crossed a shard's edges, counted since the world was created.
+struct BorderStats
+{
+    size_t departures = 0;
+    size_t arrivals = 0;
+    size_t ghosts = 0;
+};
+
+// Owns the world and advances it. Has no window, shape or font dependency so it can run
+// headless; Engine wraps it with a WindowManager for the interactive build.
+//
+// Given the same seed and the same sequence of dt values a run is reproducible, whatever the
+// thread count: the parallel phases only write per-slot state and everything that touches
+// shared state or draws random numbers happens serially in slot order, from the
+// simulation's own RandomEngine.
+class Simulation
+{
+public:
+    // thread_count counts the calling thread; 0 uses every hardware thread. The world starts
+    // with creature_count creatures at random, and with plant_count plants or a randomly
+    // filled food field, depending on food_model.
+    // A shard of a bigger world only owns the strip of it from region_left to region_right:
+    // everything it spawns lands there, plants spawn in proportion to the strip's width, and
+    // the food model has to be Plants.
+    explicit Simulation(const unsigned int seed = SimulationSettings::default_seed, const size_t thread_count = 0,
+        const size_t plant_count = SimulationSettings::initial_plant_count,
+        const size_t creature_count = SimulationSettings::initial_creature_count,
+        const FoodModel food_model = FoodModel::Plants,
+        const float region_left = 0.0f, const float region_right = world_extent.x);
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    void tick(const float dt);
+
+    // How often brains are evaluated. Sensing and inference are most of a tick, so thinking
+    // less often buys room for more creatures at some cost in how sharp they are. Every
+    // creature thinks at least every think_interval ticks, and less often when more than
+    // think_budget of them (0: no limit) would think in one tick. Slots take turns so about
+    // the same number think each tick, and newborns think on their first. In between, a
+    // creature keeps moving, eating and fighting by its last decision, and still pays energy
+    // every tick. Not in snapshots: a resumed run needs the same rate to go on the same way.
+    // The defaults think every tick.
+    void set_think_rate(const size_t think_interval, const size_t think_budget = SimulationSettings::default_think_budget);
+    // The interval the next tick will use, after the budget.
+    size_t get_think_interval() const;
+    // How far int8 brains would have strayed from the float ones so far, see
+    // WeightPrecision::Validate.
+    inline const BrainDivergence& get_brain_divergence() const { return brains_.get_divergence(); }
+
+    // Whether chunks of the world out of every creature's reach sleep. A sleeping chunk's
+    // plants are neither sensed nor acted on; when a creature comes close or a plant is born
+    // there, the chunk wakes and its plants catch up on the growth they missed in one step,
+    // see PlantStore::catch_up. Ticks then cost in proportion to the plants near creatures
+    // rather than all of them. The catch up is exact for plants growing alone but only near
+    // the tick by tick result once they touch, so runs differ from ones without sleeping.
+    // Only plant food sleeps, and never in a shard. Not in snapshots, like the think rate;
+    // switching it off wakes everything at the next tick.
+    inline void set_sleeping_chunks(const bool sleeping) { sleeping_chunks_ = sleeping; }
+    // Empty when nothing is sleeping or can.
+    inline const ChunkMap& get_chunks() const { return chunks_; }
+    // Migration between worlds, only ever between ticks. emigrate takes up to count living
+    // creatures picked at random out of the world and appends their genomes to out;
+    // immigrate brings genomes in as newborns at random positions.
+    void emigrate(const size_t count, std::vector<CreatureGenome>& out);
+    void immigrate(const std::vector<CreatureGenome>& genomes);
+
+    // Exchange with the shards on either side, between ticks, see ShardRunner. write_border
+    // hands every creature that has left the region to the neighbour on that side, brain and
+    // all, and copies whatever lies within halo of each edge for that neighbour to see.
+    // read_border takes in what a neighbour wrote: arrivals join the world, and the copies
+    // are ghosts that can be seen through the next tick but not eaten, attacked or moved.
+    void write_border(const float halo, BinaryWriter& low, BinaryWriter& high);
+    bool read_border(BinaryReader& in);
+    inline const BorderStats& get_border_stats() const { return border_stats_; }
+    // For a shard: how many creatures lived in the whole world, every shard's together, when
+    // the last tick ended. A shard respawns only when that is none, so every strip respawns
+    // at once and only when a single world would have; a strip that merely empties waits for
+    // creatures to wander back in.
+    inline void set_world_creature_count(const size_t count) { world_creature_count_ = count; }
+    inline const PlantStore& get_plants() const { return plants_; }
+    inline const CreatureStore& get_creatures() const { return creatures_; }
+    inline const FoodField& get_food_field() const { return food_field_; }
+    inline FoodModel get_food_model() const { return food_field_.is_empty() ? FoodModel::Plants : FoodModel::Field; }
+    inline size_t get_thread_count() const { return jobs_.get_thread_count(); }
+    // Simulated seconds and ticks since the world was created.
+    inline double get_time() const { return time_; }
+    inline sf::Uint64 get_tick_count() const { return tick_count_; }
+
+    // Everything a later tick depends on, so a loaded world carries on exactly where the
+    // saved one was.
+    void write(BinaryWriter& out) const;
+    // Leaves the world as it was if the data is incomplete or doesn't fit together.
+    bool read(BinaryReader& in);
+
+private:
+    // Wakes and puts chunks to sleep for the coming tick and gathers the plants of the awake
+    // ones into awake_plants_. new_plants_ were born this tick and have nothing to catch up on.
+    void update_chunks();
+    // Forgets the plants that died from the awake chunks, the only ones where plants die.
+    void remove_dead_from_chunks();
+
+    PlantStore plants_;
+    CreatureStore creatures_;
+    // Empty unless the food model is Field.
+    FoodField food_field_;
+    // Empty while every plant is awake.
+    ChunkMap chunks_;
+    bool sleeping_chunks_ = false;
+    std::vector<sf::Uint32> awake_plants_;
+    // Plants spawned this tick.
+    std::vector<sf::Uint32> new_plants_;
+    PlantCatchUpScratch catch_up_scratch_;
+    SpatialGrid plant_grid_;
+    SpatialGrid creature_grid_;
+    BrainBatch brains_;
+    JobPool jobs_;
+    RandomEngine random_;
+    float time_until_plant_spawn_;
+    float region_left_;
+    float region_right_;
+    // The region's width as a fraction of the world's.
+    float region_share_;
+    // Ghosts among the creatures until the end of the tick.
+    size_t ghost_creature_count_ = 0;
+    // Only used by shards, see set_world_creature_count.
+    size_t world_creature_count_ = 0;
+    size_t think_interval_ = SimulationSettings::default_think_interval;
+    size_t think_budget_ = SimulationSettings::default_think_budget;
+    // get_think_interval for the current tick.
+    size_t tick_think_interval_ = 1;
+    BorderStats border_stats_;
+    double time_ = 0.0;
+    sf::Uint64 tick_count_ = 0;
+};
@@ -0,0 +1,28 @@
+﻿#include "SimulationClock.h"
+
+SimulationClock::SimulationClock(const float step, const size_t max_steps_per_frame)
+    : step_(step), max_steps_per_frame_(max_steps_per_frame)
+{
+}
+
+size_t SimulationClock::advance(const double seconds)
+{
+    if(fixed_steps_per_frame_ > 0)
+        return fixed_steps_per_frame_;
+
+    accumulated_time_ += std::max(0.0, seconds);
+    size_t steps = static_cast<size_t>(accumulated_time_ / step_);
+    if(steps > max_steps_per_frame_)
+    {
+        dropped_time_ += static_cast<double>(steps - max_steps_per_frame_) * step_;
+        steps = max_steps_per_frame_;
+    }
+    accumulated_time_ -= static_cast<double>(static_cast<size_t>(accumulated_time_ / step_)) * step_;
+    return steps;
+}
+
+void SimulationClock::set_fixed_steps_per_frame(const size_t n)
+{
+    fixed_steps_per_frame_ = n;
+    accumulated_time_ = 0.0;
+}
@@ -0,0 +1,41 @@
+﻿#pragma once
+#include "Common.h"
+
+namespace SimulationClockSettings
+{
+    // Simulated seconds per tick. Every tick uses exactly this, so a run's results only
+    // depend on how many ticks it ran, never on the frame rate or the speed-up.
+    static constexpr float default_step = 1.0f / 60.0f;
+    // A slow frame never runs more ticks than this. Whatever is left over is dropped
+    // instead of snowballing into ever slower frames.
+    static constexpr size_t max_steps_per_frame = 240;
+}
+
+// Turns real frame times into a whole number of fixed simulation steps.
+//   SimulationClock clock;
+//   for(size_t steps = clock.advance(frame_seconds * speed); steps > 0; steps--)
+//       simulation.tick(clock.get_step());
+class SimulationClock
+{
+public:
+    explicit SimulationClock(const float step = SimulationClockSettings::default_step,
+        const size_t max_steps_per_frame = SimulationClockSettings::max_steps_per_frame);
+
+    // Adds seconds of (already sped up) time and returns the steps now due. Leftovers
+    // smaller than one step carry over to the next frame.
+    size_t advance(const double seconds);
+    // With n > 0 every advance returns exactly n steps, whatever time it is given, so a
+    // world can run as fast as the machine allows. 0 goes back to following real time.
+    void set_fixed_steps_per_frame(const size_t n);
+
+    inline float get_step() const { return step_; }
+    // Simulated seconds thrown away because frames fell behind max_steps_per_frame.
+    inline double get_dropped_time() const { return dropped_time_; }
+
+private:
+    float step_;
+    size_t max_steps_per_frame_;
+    size_t fixed_steps_per_frame_ = 0;
+    double accumulated_time_ = 0.0;
+    double dropped_time_ = 0.0;
+};
@@ -0,0 +1,218 @@
+﻿#include "Snapshot.h"
+
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::vector<char> make_snapshot(const Simulation& simulation)
+{
+    BinaryWriter out;
+    out.append(SnapshotSettings::magic, sizeof(SnapshotSettings::magic));
+    out.write(SnapshotSettings::version);
+    const size_t size_offset = out.get_bytes().size();
+    out.write<sf::Uint64>(0);
+
+    simulation.write(out);
+
+    auto& bytes = out.get_bytes();
+    const sf::Uint64 payload_size = bytes.size() - size_offset - sizeof(sf::Uint64);
+    std::memcpy(bytes.data() + size_offset, &payload_size, sizeof(payload_size));
+    return std::move(bytes);
+}
+
+bool write_snapshot_file(const std::vector<char>& bytes, const std::string& path)
+{
+    const std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if(!file)
+            return false;
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if(!file)
+            return false;
+    }
+#ifdef _WIN32
+    // rename doesn't replace existing files here.
+    std::remove(path.c_str());
+#endif
+    return std::rename(temporary_path.c_str(), path.c_str()) == 0;
+}
+
+bool save_snapshot(const Simulation& simulation, const std::string& path)
+{
+    return write_snapshot_file(make_snapshot(simulation), path);
+}
+
+bool load_snapshot(Simulation& simulation, const std::string& path)
+{
+    MappedFile file;
+    if(!file.open(path))
+        return false;
+
+    BinaryReader in(file.get_data(), file.get_size());
+    char magic[sizeof(SnapshotSettings::magic)];
+    sf::Uint32 version;
+    sf::Uint64 payload_size;
+    if(!in.take(magic, sizeof(magic)) || std::memcmp(magic, SnapshotSettings::magic, sizeof(magic)) != 0)
+        return false;
+    if(!in.read(version) || version != SnapshotSettings::version)
+        return false;
+    if(!in.read(payload_size) || payload_size != in.get_remaining())
+        return false;
+
+    return simulation.read(in) && in.get_remaining() == 0;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& path)
+{
+    close();
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file_ == INVALID_HANDLE_VALUE)
+    {
+        file_ = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    data_ = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if(!data_)
+    {
+        close();
+        return false;
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(data_)
+        UnmapViewOfFile(data_);
+    if(mapping_)
+        CloseHandle(mapping_);
+    if(file_)
+        CloseHandle(file_);
+    data_ = nullptr;
+    mapping_ = nullptr;
+    file_ = nullptr;
+    size_ = 0;
+}
+#else
+bool MappedFile::open(const std::string& path)
+{
+    close();
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if(file < 0)
+        return false;
+
+    struct stat info;
+    if(fstat(file, &info) != 0 || info.st_size <= 0)
+    {
+        ::close(file);
+        return false;
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if(data == MAP_FAILED)
+        return false;
+
+    // Loading reads the whole file front to back once.
+    madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+    data_ = data;
+    size_ = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(data_)
+        munmap(const_cast<void*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+#endif
+
+SnapshotSaver::SnapshotSaver()
+{
+    thread_ = std::thread(&SnapshotSaver::writer_loop, this);
+}
+
+SnapshotSaver::~SnapshotSaver()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+}
+
+void SnapshotSaver::save(const Simulation& simulation, const std::string& path)
+{
+    auto bytes = make_snapshot(simulation);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_bytes_ = std::move(bytes);
+        pending_path_ = path;
+        has_pending_ = true;
+    }
+    changed_.notify_all();
+}
+
+bool SnapshotSaver::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this]{ return !has_pending_ && !writing_; });
+    return last_result_;
+}
+
+void SnapshotSaver::writer_loop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true)
+    {
+        changed_.wait(lock, [this]{ return stopping_ || has_pending_; });
+        // Pending saves still get written when stopping.
+        if(!has_pending_)
+            return;
+
+        std::vector<char> bytes = std::move(pending_bytes_);
+        const std::string path = pending_path_;
+        has_pending_ = false;
+        writing_ = true;
+
+        lock.unlock();
+        const bool result = write_snapshot_file(bytes, path);
+        lock.lock();
+
+        writing_ = false;
+        last_result_ = result;
+        changed_.notify_all();
+    }
+}
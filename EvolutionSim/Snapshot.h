@@ -0,0 +1,79 @@
+﻿#pragma once
+#include "Simulation.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Snapshot files are a fixed header followed by Simulation::write's output. The version goes
+// up whenever that layout changes; older files are rejected rather than misread.
+namespace SnapshotSettings
+{
+    static constexpr char magic[8] = {'E', 'V', 'O', 'S', 'N', 'A', 'P', '\0'};
+    static constexpr sf::Uint32 version = 6;
+}
+
+// The whole snapshot file as bytes. Cheap next to a tick: the stores are mostly copied
+// array by array.
+std::vector<char> make_snapshot(const Simulation& simulation);
+// Writes next to path first and renames over it when done, so a crash mid-save never
+// leaves a half-written snapshot behind.
+bool write_snapshot_file(const std::vector<char>& bytes, const std::string& path);
+bool save_snapshot(const Simulation& simulation, const std::string& path);
+// Maps the file instead of reading it into a buffer first. Leaves simulation untouched and
+// returns false if the file is missing, from another version or damaged.
+bool load_snapshot(Simulation& simulation, const std::string& path);
+
+// A read-only view of a whole file, through the OS' memory mapping.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    inline const void* get_data() const { return data_; }
+    inline size_t get_size() const { return size_; }
+
+private:
+    const void* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+// Saves in the background. save() only takes the in-memory copy and returns; the file is
+// written by a thread of its own. If saves come in faster than the disk keeps up, only the
+// newest waiting snapshot is written.
+class SnapshotSaver
+{
+public:
+    SnapshotSaver();
+    // Finishes whatever save is still pending.
+    ~SnapshotSaver();
+    SnapshotSaver(const SnapshotSaver&) = delete;
+    SnapshotSaver& operator=(const SnapshotSaver&) = delete;
+
+    void save(const Simulation& simulation, const std::string& path);
+    // Blocks until every requested save has been written. Returns whether the last one worked.
+    bool wait();
+
+private:
+    void writer_loop();
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<char> pending_bytes_;
+    std::string pending_path_;
+    bool has_pending_ = false;
+    bool writing_ = false;
+    bool stopping_ = false;
+    bool last_result_ = true;
+};
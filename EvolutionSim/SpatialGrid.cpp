@@ -0,0 +1,36 @@
+﻿#include "SpatialGrid.h"
+
+#include <cmath>
+
+void SpatialGrid::begin_rebuild(const float cell_size)
+{
+    cell_size_ = std::max(cell_size,
+        std::max(world_extent.x, world_extent.y) / static_cast<float>(SpatialGridSettings::max_cells_per_axis));
+    columns_ = std::max<size_t>(1, static_cast<size_t>(std::ceil(world_extent.x / cell_size_)));
+    rows_ = std::max<size_t>(1, static_cast<size_t>(std::ceil(world_extent.y / cell_size_)));
+
+    cell_start_.assign(columns_ * rows_ + 1, 0);
+    pending_.clear();
+    max_size_ = 0.0f;
+}
+
+void SpatialGrid::add(const sf::Vector2f& position, const float size, const sf::Uint32 index)
+{
+    const size_t cell = get_row(position.y) * columns_ + get_column(position.x);
+    pending_.push_back({cell, index});
+    cell_start_[cell + 1]++;
+    max_size_ = std::max(max_size_, size);
+}
+
+void SpatialGrid::finish_rebuild()
+{
+    // Counting sort: the counts gathered by add become start offsets, then everything is
+    // scattered into place.
+    for(size_t i = 1; i < cell_start_.size(); i++)
+        cell_start_[i] += cell_start_[i - 1];
+
+    cell_slots_.resize(pending_.size());
+    cell_cursor_.assign(cell_start_.begin(), cell_start_.end() - 1);
+    for(const auto& pending : pending_)
+        cell_slots_[cell_cursor_[pending.cell]++] = pending.index;
+}
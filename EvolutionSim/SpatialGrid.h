@@ -0,0 +1,95 @@
+﻿#pragma once
+#include "Common.h"
+
+// Uniform grid over world_extent holding the slots of one entity store, rebuilt once per
+// tick. Each kind gets its own grid, so a query only ever visits entities of the kind it asks
+// for. Slots are bucketed by their position only, so queries have to widen their radius by
+// get_max_size() when they care about overlaps rather than centres.
+class SpatialGrid
+{
+public:
+    // Takes every used slot of a PlantStore or CreatureStore.
+    template <typename Store>
+    void rebuild(const Store& store, const float cell_size);
+
+    // Rebuilding by hand is begin_rebuild, one add per slot, then finish_rebuild.
+    void begin_rebuild(const float cell_size);
+    void add(const sf::Vector2f& position, const float size, const sf::Uint32 index);
+    void finish_rebuild();
+
+    template <typename F>
+    void for_each_in_radius(const sf::Vector2f& center, const float radius, F&& func) const;
+
+    inline float get_max_size() const { return max_size_; }
+    inline float get_cell_size() const { return cell_size_; }
+
+private:
+    inline size_t get_column(const float x) const;
+    inline size_t get_row(const float y) const;
+
+    struct PendingThing
+    {
+        size_t cell;
+        sf::Uint32 index;
+    };
+
+    float cell_size_ = 1.0f;
+    float max_size_ = 0.0f;
+    size_t columns_ = 0;
+    size_t rows_ = 0;
+    std::vector<size_t> cell_start_;
+    std::vector<size_t> cell_cursor_;
+    std::vector<PendingThing> pending_;
+    std::vector<sf::Uint32> cell_slots_;
+};
+
+namespace SpatialGridSettings
+{
+    // Keeps the cell table bounded if the cell size ever ends up tiny compared to the world.
+    static constexpr size_t max_cells_per_axis = 1024;
+}
+
+size_t SpatialGrid::get_column(const float x) const
+{
+    if(x <= 0.0f)
+        return 0;
+    return std::min(static_cast<size_t>(x / cell_size_), columns_ - 1);
+}
+
+size_t SpatialGrid::get_row(const float y) const
+{
+    if(y <= 0.0f)
+        return 0;
+    return std::min(static_cast<size_t>(y / cell_size_), rows_ - 1);
+}
+
+template <typename Store>
+void SpatialGrid::rebuild(const Store& store, const float cell_size)
+{
+    begin_rebuild(cell_size);
+    for(size_t i = 0; i < store.get_capacity(); i++)
+        if(store.is_used(i))
+            add(store.position[i], store.size[i], static_cast<sf::Uint32>(i));
+    finish_rebuild();
+}
+
+template <typename F>
+void SpatialGrid::for_each_in_radius(const sf::Vector2f& center, const float radius, F&& func) const
+{
+    if(cell_slots_.empty())
+        return;
+
+    const size_t column_begin = get_column(center.x - radius);
+    const size_t column_end = get_column(center.x + radius);
+    const size_t row_begin = get_row(center.y - radius);
+    const size_t row_end = get_row(center.y + radius);
+
+    for(size_t row = row_begin; row <= row_end; row++)
+    {
+        // Cells of a row are stored back to back, so the whole span is one contiguous range.
+        const size_t first = cell_start_[row * columns_ + column_begin];
+        const size_t last = cell_start_[row * columns_ + column_end + 1];
+        for(size_t i = first; i < last; i++)
+            func(cell_slots_[i]);
+    }
+}
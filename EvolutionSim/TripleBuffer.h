@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <atomic>
+
+// Hands the latest of a stream of values from one writing thread to one reading thread
+// without locks or waiting. There are three slots: the writer fills its back slot and
+// publish swaps it with the middle one, and take_latest swaps the middle slot with the
+// reader's front one if something new was published since. Neither side ever touches the
+// other's slot, and the reader may skip values but never sees one half written.
+//
+// Slots are reused, not recreated, so a T holding vectors stops allocating once they have
+// grown to size. Whatever the writer left in its new back slot is two values old.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer side.
+    inline T& get_back() { return slots_[back_]; }
+    inline void publish()
+    {
+        back_ = static_cast<unsigned char>(middle_.exchange(back_ | fresh_bit, std::memory_order_acq_rel) & index_mask);
+    }
+
+    // Reader side. True if the front slot now holds a value it didn't before.
+    inline bool take_latest()
+    {
+        if(!(middle_.load(std::memory_order_relaxed) & fresh_bit))
+            return false;
+        front_ = static_cast<unsigned char>(middle_.exchange(front_, std::memory_order_acq_rel) & index_mask);
+        return true;
+    }
+    inline const T& get_front() const { return slots_[front_]; }
+
+private:
+    static constexpr unsigned char index_mask = 3;
+    // Set in middle_ by publish, cleared by take_latest.
+    static constexpr unsigned char fresh_bit = 4;
+
+    T slots_[3];
+    unsigned char back_ = 0;
+    unsigned char front_ = 1;
+    std::atomic<unsigned char> middle_{2};
+};
@@ -0,0 +1,168 @@
+﻿#include "Vision.h"
+
+#include "Simd.h"
+
+void get_vision_angle_terms(const float half_angle, float& cos_out, float& sin_out)
+{
+    // sin(pi) isn't quite zero, which would leave straight behind out of an all around view.
+    if(half_angle >= 180.0f)
+    {
+        cos_out = -1.0f;
+        sin_out = 0.0f;
+        return;
+    }
+    const double radians = static_cast<double>(std::max(half_angle, 0.0f)) * PI / 180.0;
+    cos_out = static_cast<float>(std::cos(radians));
+    sin_out = static_cast<float>(std::sin(radians));
+}
+
+VisionCone make_vision_cone(const sf::Vector2f& position, const sf::Vector2f& forward, const float size,
+    const float distance, const float cos_half_angle, const float sin_half_angle)
+{
+    const bool has_forward = forward.x != 0.0f || forward.y != 0.0f;
+    return {position, forward, size, distance * distance, cos_half_angle, sin_half_angle,
+        has_forward ? 1.0f : 0.0f, has_forward ? 0.0f : 1.0f};
+}
+
+// With the offset at angle t off forward and b = atan(size / distance), (x, y) below points
+// at angle t - b, scaled by distance * sqrt(distance^2 + size^2). It is inside the cone when
+// that angle is at most the half angle a: either it is at or right of forward (y <= 0 < x),
+// or it is left of forward but not past a (0 <= y and sin(t - b - a) <= 0).
+// The SIMD kernels run exactly these operations in this order, lane by lane.
+static float see_one(const VisionCone& cone, const float x, const float y, const float size)
+{
+    const float offset_x = x - cone.position.x;
+    const float offset_y = y - cone.position.y;
+    const float distance_squared = offset_x * offset_x + offset_y * offset_y;
+    const float reach = cone.size + size;
+    const bool overlapping = distance_squared < reach * reach;
+    const bool in_range = distance_squared <= cone.distance_squared && distance_squared > 0.0f;
+    // Only a shortcut; the result is the same without it.
+    if(!overlapping && !in_range)
+        return VisionSettings::not_seen;
+
+    const float distance = std::sqrt(distance_squared);
+    const float along = offset_x * cone.forward.x + offset_y * cone.forward.y;
+    const float across = std::fabs(offset_x * cone.forward.y - offset_y * cone.forward.x) * cone.cross_weight +
+        distance * cone.distance_weight;
+    const float rotated_x = along * distance + across * size;
+    const float rotated_y = across * distance - along * size;
+    const bool right_of_forward = rotated_y <= 0.0f && rotated_x > 0.0f;
+    const bool inside_left = rotated_y >= 0.0f &&
+        rotated_y * cone.cos_half_angle <= rotated_x * cone.sin_half_angle;
+    const bool in_cone = in_range && (right_of_forward || inside_left);
+
+    return overlapping || in_cone ? distance - size : VisionSettings::not_seen;
+}
+
+static void see_scalar(const VisionCone& cone, const float* x, const float* y, const float* size,
+    const size_t count, float* out)
+{
+    for(size_t i = 0; i < count; i++)
+        out[i] = see_one(cone, x[i], y[i], size[i]);
+}
+
+#if SIMD_X86
+SIMD_TARGET_SSE static void see_sse(const VisionCone& cone, const float* x, const float* y, const float* size,
+    const size_t count, float* out)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 position_x = _mm_set1_ps(cone.position.x);
+    const __m128 position_y = _mm_set1_ps(cone.position.y);
+    const __m128 forward_x = _mm_set1_ps(cone.forward.x);
+    const __m128 forward_y = _mm_set1_ps(cone.forward.y);
+
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        const __m128 other_size = _mm_loadu_ps(size + i);
+        const __m128 offset_x = _mm_sub_ps(_mm_loadu_ps(x + i), position_x);
+        const __m128 offset_y = _mm_sub_ps(_mm_loadu_ps(y + i), position_y);
+        const __m128 distance_squared = _mm_add_ps(_mm_mul_ps(offset_x, offset_x), _mm_mul_ps(offset_y, offset_y));
+        const __m128 reach = _mm_add_ps(_mm_set1_ps(cone.size), other_size);
+        const __m128 overlapping = _mm_cmplt_ps(distance_squared, _mm_mul_ps(reach, reach));
+
+        const __m128 distance = _mm_sqrt_ps(distance_squared);
+        const __m128 along = _mm_add_ps(_mm_mul_ps(offset_x, forward_x), _mm_mul_ps(offset_y, forward_y));
+        const __m128 cross = _mm_sub_ps(_mm_mul_ps(offset_x, forward_y), _mm_mul_ps(offset_y, forward_x));
+        const __m128 across = _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, cross), _mm_set1_ps(cone.cross_weight)),
+            _mm_mul_ps(distance, _mm_set1_ps(cone.distance_weight)));
+        const __m128 rotated_x = _mm_add_ps(_mm_mul_ps(along, distance), _mm_mul_ps(across, other_size));
+        const __m128 rotated_y = _mm_sub_ps(_mm_mul_ps(across, distance), _mm_mul_ps(along, other_size));
+        const __m128 right_of_forward = _mm_and_ps(_mm_cmple_ps(rotated_y, zero), _mm_cmpgt_ps(rotated_x, zero));
+        const __m128 inside_left = _mm_and_ps(_mm_cmpge_ps(rotated_y, zero), _mm_cmple_ps(
+            _mm_mul_ps(rotated_y, _mm_set1_ps(cone.cos_half_angle)),
+            _mm_mul_ps(rotated_x, _mm_set1_ps(cone.sin_half_angle))));
+        const __m128 in_range = _mm_and_ps(_mm_cmple_ps(distance_squared, _mm_set1_ps(cone.distance_squared)),
+            _mm_cmpgt_ps(distance_squared, zero));
+        const __m128 seen = _mm_or_ps(overlapping, _mm_and_ps(in_range, _mm_or_ps(right_of_forward, inside_left)));
+
+        _mm_storeu_ps(out + i, _mm_or_ps(
+            _mm_and_ps(seen, _mm_sub_ps(distance, other_size)),
+            _mm_andnot_ps(seen, _mm_set1_ps(VisionSettings::not_seen))));
+    }
+    see_scalar(cone, x + i, y + i, size + i, count - i, out + i);
+}
+
+SIMD_TARGET_AVX2 static void see_avx2(const VisionCone& cone, const float* x, const float* y, const float* size,
+    const size_t count, float* out)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 position_x = _mm256_set1_ps(cone.position.x);
+    const __m256 position_y = _mm256_set1_ps(cone.position.y);
+    const __m256 forward_x = _mm256_set1_ps(cone.forward.x);
+    const __m256 forward_y = _mm256_set1_ps(cone.forward.y);
+
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        const __m256 other_size = _mm256_loadu_ps(size + i);
+        const __m256 offset_x = _mm256_sub_ps(_mm256_loadu_ps(x + i), position_x);
+        const __m256 offset_y = _mm256_sub_ps(_mm256_loadu_ps(y + i), position_y);
+        const __m256 distance_squared = _mm256_add_ps(_mm256_mul_ps(offset_x, offset_x),
+            _mm256_mul_ps(offset_y, offset_y));
+        const __m256 reach = _mm256_add_ps(_mm256_set1_ps(cone.size), other_size);
+        const __m256 overlapping = _mm256_cmp_ps(distance_squared, _mm256_mul_ps(reach, reach), _CMP_LT_OQ);
+
+        const __m256 distance = _mm256_sqrt_ps(distance_squared);
+        const __m256 along = _mm256_add_ps(_mm256_mul_ps(offset_x, forward_x), _mm256_mul_ps(offset_y, forward_y));
+        const __m256 cross = _mm256_sub_ps(_mm256_mul_ps(offset_x, forward_y), _mm256_mul_ps(offset_y, forward_x));
+        const __m256 across = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_andnot_ps(sign, cross), _mm256_set1_ps(cone.cross_weight)),
+            _mm256_mul_ps(distance, _mm256_set1_ps(cone.distance_weight)));
+        const __m256 rotated_x = _mm256_add_ps(_mm256_mul_ps(along, distance), _mm256_mul_ps(across, other_size));
+        const __m256 rotated_y = _mm256_sub_ps(_mm256_mul_ps(across, distance), _mm256_mul_ps(along, other_size));
+        const __m256 right_of_forward = _mm256_and_ps(_mm256_cmp_ps(rotated_y, zero, _CMP_LE_OQ),
+            _mm256_cmp_ps(rotated_x, zero, _CMP_GT_OQ));
+        const __m256 inside_left = _mm256_and_ps(_mm256_cmp_ps(rotated_y, zero, _CMP_GE_OQ), _mm256_cmp_ps(
+            _mm256_mul_ps(rotated_y, _mm256_set1_ps(cone.cos_half_angle)),
+            _mm256_mul_ps(rotated_x, _mm256_set1_ps(cone.sin_half_angle)), _CMP_LE_OQ));
+        const __m256 in_range = _mm256_and_ps(
+            _mm256_cmp_ps(distance_squared, _mm256_set1_ps(cone.distance_squared), _CMP_LE_OQ),
+            _mm256_cmp_ps(distance_squared, zero, _CMP_GT_OQ));
+        const __m256 seen = _mm256_or_ps(overlapping,
+            _mm256_and_ps(in_range, _mm256_or_ps(right_of_forward, inside_left)));
+
+        _mm256_storeu_ps(out + i, _mm256_blendv_ps(_mm256_set1_ps(VisionSettings::not_seen),
+            _mm256_sub_ps(distance, other_size), seen));
+    }
+    // Same reason as in the AVX2 layer kernel: the SSE code below isn't VEX encoded.
+    _mm256_zeroupper();
+    see_sse(cone, x + i, y + i, size + i, count - i, out + i);
+}
+#endif
+
+VisionKernel get_vision_kernel()
+{
+#if SIMD_X86
+    switch(get_simd_level())
+    {
+    case SimdLevel::Avx2: return see_avx2;
+    case SimdLevel::Sse: return see_sse;
+    case SimdLevel::Scalar: break;
+    }
+#endif
+    return see_scalar;
+}
@@ -0,0 +1,97 @@
+﻿#pragma once
+#include "Common.h"
+
+// Vision-cone tests for sensing. A creature sees anything overlapping it, and anything whose
+// centre is within its vision distance and at most
+//   half_angle + atan(size / distance)
+// degrees off its forward direction, so big things can be seen a little past the edge of the
+// cone. A creature that hasn't moved yet has no forward direction and counts everything as
+// straight beside it, 90 degrees off.
+//
+// Rather than working the angles out with acos and atan, the cone keeps the cosine and sine
+// of its half angle, and a candidate's offset is rotated against them with multiplies and
+// compares only. The one square root left per candidate is the distance the atan term and
+// the nearest-candidate ranking need anyway.
+//
+// This agrees with the angular test exactly in real arithmetic; in floats the two only
+// disagree for candidates within about 1e-5 degrees of the cone's edge.
+namespace VisionSettings
+{
+    // Candidates gathered before the kernel runs over them.
+    static constexpr size_t block_size = 64;
+    // What the kernel reports for candidates that can't be seen.
+    static constexpr float not_seen = FLT_MAX;
+}
+
+struct VisionCone
+{
+    sf::Vector2f position;
+    // Unit length, or zero for a creature that hasn't moved yet.
+    sf::Vector2f forward;
+    float size;
+    float distance_squared;
+    float cos_half_angle;
+    float sin_half_angle;
+    // The candidate's sideways offset is cross_weight * |cross(offset, forward)| +
+    // distance_weight * distance: 1 and 0 normally, 0 and 1 without a forward direction.
+    float cross_weight;
+    float distance_weight;
+};
+
+// half_angle is in degrees, and anything past 180 sees all around.
+void get_vision_angle_terms(const float half_angle, float& cos_out, float& sin_out);
+VisionCone make_vision_cone(const sf::Vector2f& position, const sf::Vector2f& forward, const float size,
+    const float distance, const float cos_half_angle, const float sin_half_angle);
+
+// For each candidate, out is its edge distance (from the cone's centre to the candidate's
+// centre, minus the candidate's size) if it can be seen, or VisionSettings::not_seen.
+typedef void(*VisionKernel)(const VisionCone& cone, const float* x, const float* y, const float* size,
+    const size_t count, float* out);
+// The kernel for the current SIMD level. Every level gives the same bits.
+VisionKernel get_vision_kernel();
+
+// Candidates of one sensing query, gathered until the block is full and then tested together.
+// T is whatever the caller needs to tell the candidates apart afterwards.
+template <typename T>
+class VisionBlock
+{
+public:
+    // False once the block is full; flush it and add again.
+    inline bool add(const sf::Vector2f& position, const float size, const T& tag);
+    // Runs kernel over the gathered candidates, calls func(tag, edge_distance, position, size)
+    // for every visible one in the order they were added, and empties the block.
+    template <typename F>
+    void flush(const VisionCone& cone, const VisionKernel kernel, F&& func);
+
+private:
+    size_t count_ = 0;
+    float x_[VisionSettings::block_size];
+    float y_[VisionSettings::block_size];
+    float size_[VisionSettings::block_size];
+    float distance_[VisionSettings::block_size];
+    T tags_[VisionSettings::block_size];
+};
+
+template <typename T>
+bool VisionBlock<T>::add(const sf::Vector2f& position, const float size, const T& tag)
+{
+    if(count_ == VisionSettings::block_size)
+        return false;
+    x_[count_] = position.x;
+    y_[count_] = position.y;
+    size_[count_] = size;
+    tags_[count_] = tag;
+    count_++;
+    return true;
+}
+
+template <typename T>
+template <typename F>
+void VisionBlock<T>::flush(const VisionCone& cone, const VisionKernel kernel, F&& func)
+{
+    kernel(cone, x_, y_, size_, count_, distance_);
+    for(size_t i = 0; i < count_; i++)
+        if(distance_[i] != VisionSettings::not_seen)  // NOLINT(clang-diagnostic-float-equal)
+            func(tags_[i], distance_[i], sf::Vector2f(x_[i], y_[i]), size_[i]);
+    count_ = 0;
+}
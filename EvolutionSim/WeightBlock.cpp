@@ -0,0 +1,171 @@
+﻿#include "WeightBlock.h"
+
+#include <cmath>
+#include <cstring>
+#include <new>
+
+static std::atomic<size_t> live_block_count{0};
+static std::atomic<size_t> live_block_bytes{0};
+
+WeightBlock::Header* WeightBlock::allocate(const size_t size, const bool quantised)
+{
+    static_assert(sizeof(Header) == sizeof(sf::Uint32) * 2, "the floats follow the header directly");
+    const size_t bytes = get_allocation_size(size, quantised);
+    auto header = new(static_cast<char*>(::operator new(bytes)) + get_quantised_bytes(size, quantised)) Header;
+    header->references.store(1, std::memory_order_relaxed);
+    header->size = static_cast<sf::Uint32>(size);
+    header->quantised = quantised ? 1 : 0;
+    header->stale = 0;
+    live_block_count.fetch_add(1, std::memory_order_relaxed);
+    live_block_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    return header;
+}
+
+WeightBlock::WeightBlock(const size_t size, const bool quantised)
+    : header_(allocate(size, quantised))
+{
+    std::memset(get_floats(), 0, size * sizeof(float));
+    if(quantised)
+        std::memset(reinterpret_cast<char*>(header_) - get_quantised_bytes(size, true), 0, get_quantised_bytes(size, true));
+}
+
+WeightBlock::WeightBlock(const float* values, const size_t size, const bool quantised)
+    : header_(allocate(size, quantised))
+{
+    std::memcpy(get_floats(), values, size * sizeof(float));
+    if(quantised)
+        quantise();
+}
+
+WeightBlock::WeightBlock(const WeightBlock& other)
+    : header_(other.header_)
+{
+    if(header_)
+        header_->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+WeightBlock::WeightBlock(WeightBlock&& other) noexcept
+    : header_(other.header_)
+{
+    other.header_ = nullptr;
+}
+
+WeightBlock& WeightBlock::operator=(const WeightBlock& other)
+{
+    if(header_ == other.header_)
+        return *this;
+    if(other.header_)
+        other.header_->references.fetch_add(1, std::memory_order_relaxed);
+    release();
+    header_ = other.header_;
+    return *this;
+}
+
+WeightBlock& WeightBlock::operator=(WeightBlock&& other) noexcept
+{
+    if(this != &other)
+    {
+        release();
+        header_ = other.header_;
+        other.header_ = nullptr;
+    }
+    return *this;
+}
+
+WeightBlock::~WeightBlock()
+{
+    release();
+}
+
+void WeightBlock::release()
+{
+    if(!header_)
+        return;
+    // acq_rel so the last holder sees every write made before the others let go.
+    if(header_->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        live_block_count.fetch_sub(1, std::memory_order_relaxed);
+        live_block_bytes.fetch_sub(get_allocation_size(header_->size, header_->quantised), std::memory_order_relaxed);
+        char* memory = reinterpret_cast<char*>(header_) - get_quantised_bytes(header_->size, header_->quantised);
+        header_->~Header();
+        ::operator delete(memory);
+    }
+    header_ = nullptr;
+}
+
+float* WeightBlock::make_unique()
+{
+    if(!header_)
+        return nullptr;
+    if(is_shared())
+    {
+        // Not rounded yet: the holder is about to write to it anyway.
+        Header* copy = allocate(size(), header_->quantised);
+        std::memcpy(reinterpret_cast<float*>(copy + 1), data(), size() * sizeof(float));
+        release();
+        header_ = copy;
+    }
+    header_->stale = header_->quantised;
+    return get_floats();
+}
+
+void WeightBlock::quantise()
+{
+    // The largest weight of the row maps to 127; a row of zeros stays zero.
+    const float* values = data();
+    const size_t count = size();
+    float largest = 0.0f;
+    for(size_t i = 0; i < count; i++)
+        largest = std::max(largest, std::abs(values[i]));
+    const float to_steps = largest > 0.0f ? 127.0f / largest : 0.0f;
+    float* scale = const_cast<float*>(get_scale_address());
+    *scale = largest / 127.0f;
+    auto quantised = reinterpret_cast<sf::Int8*>(scale + 1);
+    // Adding and taking away 1.5 * 2^23 rounds anything this small to the nearest whole
+    // number, ties to even, like nearbyint but without a library call per weight.
+    const float round_bias = 12582912.0f;
+    for(size_t i = 0; i < count; i++)
+    {
+        const float steps = std::min(std::max(values[i] * to_steps, -127.0f), 127.0f);
+        quantised[i] = static_cast<sf::Int8>((steps + round_bias) - round_bias);
+    }
+    header_->stale = 0;
+}
+
+size_t WeightBlock::get_live_count()
+{
+    return live_block_count.load(std::memory_order_relaxed);
+}
+
+size_t WeightBlock::get_live_bytes()
+{
+    return live_block_bytes.load(std::memory_order_relaxed);
+}
+
+void WeightBlockCounter::add(const WeightBlock& block)
+{
+    const size_t bytes = block.get_bytes();
+    stats_.logical_blocks++;
+    stats_.logical_bytes += bytes;
+    if(seen_.insert(block.get_id()).second)
+    {
+        stats_.unique_blocks++;
+        stats_.unique_bytes += bytes;
+    }
+}
+
+WeightBlock WeightBlockInterner::intern(const float* values, const size_t size, const bool quantised)
+{
+    // FNV-1a over the raw bytes; equal rows are then confirmed byte for byte.
+    sf::Uint64 hash = 0xCBF29CE484222325ull;
+    const auto bytes = reinterpret_cast<const unsigned char*>(values);
+    for(size_t i = 0; i < size * sizeof(float); i++)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+
+    const auto range = blocks_.equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it)
+        if(it->second.size() == size && it->second.is_quantised() == quantised &&
+            std::memcmp(it->second.data(), values, size * sizeof(float)) == 0)
+            return it->second;
+    return blocks_.emplace(hash, WeightBlock(values, size, quantised))->second;
+}
@@ -0,0 +1,124 @@
+﻿#pragma once
+#include "Common.h"
+
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+
+// A reference-counted row of brain weights. Copying a block only shares it; the floats are
+// copied the first time a holder writes to a block someone else holds as well. Offspring
+// start out sharing every row of their parent's brain and only own the few rows their
+// mutations touched, so a lineage costs little more than its first member.
+// Counts are atomic, so brains may be copied and dropped on any thread.
+//
+// A quantised block also holds its floats rounded to int8, each standing for that many times
+// one scale for the row, see WeightPrecision. The int8 copy is shared along with the floats,
+// and only the blocks a holder wrote to need rounding again.
+class WeightBlock
+{
+public:
+    WeightBlock() = default;
+    // size zeroed floats, held by this block alone.
+    explicit WeightBlock(const size_t size, const bool quantised = false);
+    WeightBlock(const float* values, const size_t size, const bool quantised = false);
+    WeightBlock(const WeightBlock& other);
+    WeightBlock(WeightBlock&& other) noexcept;
+    WeightBlock& operator=(const WeightBlock& other);
+    WeightBlock& operator=(WeightBlock&& other) noexcept;
+    ~WeightBlock();
+
+    inline const float* data() const { return header_ ? reinterpret_cast<const float*>(header_ + 1) : nullptr; }
+    inline size_t size() const { return header_ ? header_->size : 0; }
+    inline bool is_shared() const { return header_ && header_->references.load(std::memory_order_acquire) > 1; }
+    // Identifies the shared storage, for telling apart blocks that merely hold equal values.
+    inline const void* get_id() const { return header_; }
+    // What the storage takes, header included.
+    inline size_t get_bytes() const { return header_ ? get_allocation_size(header_->size, header_->quantised) : 0; }
+    // The floats for writing, copied into a block of this holder's own first if shared. The
+    // int8 copy is out of date from then until update_quantised.
+    float* make_unique();
+
+    inline bool is_quantised() const { return header_ && header_->quantised; }
+    // Null unless quantised.
+    inline const sf::Int8* get_quantised() const
+    {
+        return is_quantised() ? reinterpret_cast<const sf::Int8*>(get_scale_address() + 1) : nullptr;
+    }
+    inline float get_quantised_scale() const { return is_quantised() ? *get_scale_address() : 0.0f; }
+    // Rounds the floats again if they were written to since they last were.
+    inline void update_quantised()
+    {
+        if(header_ && header_->stale)
+            quantise();
+    }
+
+    // Blocks alive in the whole process and the bytes they take, headers included.
+    static size_t get_live_count();
+    static size_t get_live_bytes();
+
+private:
+    // The floats follow the header. A quantised block has the scale and then the int8 values
+    // in front of it, at the start of the allocation, so thinking in int8 reads one short
+    // run per row and never the floats.
+    struct Header
+    {
+        std::atomic<sf::Uint32> references;
+        sf::Uint32 size : 30;
+        sf::Uint32 quantised : 1;
+        // Only ever set on a block held by one holder, see make_unique.
+        sf::Uint32 stale : 1;
+    };
+
+    static Header* allocate(const size_t size, const bool quantised);
+    inline float* get_floats() { return reinterpret_cast<float*>(header_ + 1); }
+    static inline size_t get_quantised_bytes(const size_t size, const bool quantised)
+    {
+        // Rounded up so the header after it stays aligned.
+        return quantised ? (sizeof(float) + size * sizeof(sf::Int8) + alignof(Header) - 1) / alignof(Header) * alignof(Header) : 0;
+    }
+    static inline size_t get_allocation_size(const size_t size, const bool quantised)
+    {
+        return get_quantised_bytes(size, quantised) + sizeof(Header) + size * sizeof(float);
+    }
+    inline const float* get_scale_address() const
+    {
+        return reinterpret_cast<const float*>(reinterpret_cast<const char*>(header_) - get_quantised_bytes(header_->size, true));
+    }
+    void quantise();
+    void release();
+
+    Header* header_ = nullptr;
+};
+
+// How much brains share. Logical blocks are the row references the counted brains hold,
+// unique blocks the distinct storage behind them.
+struct WeightBlockStats
+{
+    size_t logical_blocks = 0;
+    size_t unique_blocks = 0;
+    // What the counted rows would take unshared, and what they actually take.
+    size_t logical_bytes = 0;
+    size_t unique_bytes = 0;
+};
+
+class WeightBlockCounter
+{
+public:
+    void add(const WeightBlock& block);
+    inline const WeightBlockStats& get_stats() const { return stats_; }
+
+private:
+    std::unordered_set<const void*> seen_;
+    WeightBlockStats stats_;
+};
+
+// Hands out one shared block per distinct row, for rows that arrive without their sharing,
+// such as brains loaded from a snapshot.
+class WeightBlockInterner
+{
+public:
+    WeightBlock intern(const float* values, const size_t size, const bool quantised = false);
+
+private:
+    std::unordered_multimap<sf::Uint64, WeightBlock> blocks_;
+};
@@ -1,5 +1,14 @@
 ﻿#include "WindowManager.h"
 
+#include "Profiler.h"
+
+sf::Font global_font;
+
+static sf::Color to_sf_color(const Color& color)
+{
+    return {color.r, color.g, color.b};
+}
+
 WindowManager::WindowManager()
 {
     window_ = new sf::RenderWindow();
@@ -7,6 +16,17 @@ WindowManager::WindowManager()
         static_cast<unsigned int>(world_extent.x), static_cast<unsigned int>(world_extent.y)),
         "Evolution Sim",
         sf::Style::Close);
+    // Drawing has a thread of its own, so waiting for the display never holds up the world.
+    window_->setVerticalSyncEnabled(true);
+
+#if DRAW_DEBUG_DATA
+    debug_text_.setFont(global_font);
+    debug_text_.setString("Creature");
+    debug_text_.setFillColor(sf::Color::Magenta);
+    debug_text_.setOutlineColor(sf::Color::Black);
+    debug_text_.setOutlineThickness(0.25f);
+    debug_text_.setCharacterSize(11);
+#endif
 }
 
 WindowManager::~WindowManager()
@@ -15,20 +35,91 @@ WindowManager::~WindowManager()
     delete window_;
 }
 
-void WindowManager::draw(const std::vector<Thing*>& things_in_world) const
+void WindowManager::draw(const FrameSnapshot& frame)
 {
     window_->clear();
-    for (const auto thing : things_in_world)
-        thing->draw(*window_);
+
+    shapes_.clear();
+    shapes_.set_pixels_per_unit(static_cast<float>(window_->getSize().x) / window_->getView().getSize().x);
+    add_food_field(frame.food);
+    for(size_t i = 0; i < frame.plant_positions.size(); i++)
+        add_plant(frame, i);
+    for(size_t i = 0; i < frame.creature_positions.size(); i++)
+        add_creature(frame, i);
+    shapes_.draw(*window_);
+
+#if DRAW_DEBUG_DATA
+    for(size_t i = 0; i < frame.creature_positions.size(); i++)
+        draw_creature_debug_data(frame, i);
+#endif
+
     static sf::Clock clock;
     sf::Text stat_text;
     stat_text.setCharacterSize(18);
     sf::String text_to_display = std::to_string(static_cast<unsigned int>(1.0f / clock.restart().asSeconds())) + " fps\n";
-    text_to_display += std::to_string(Plant::plant_count) + " plants\n";
-    text_to_display += std::to_string(Creature::creatures_count) + " creatures\n";
+    text_to_display += "tick " + std::to_string(frame.tick) + "\n";
+    if(frame.food.is_empty())
+        text_to_display += std::to_string(frame.plant_positions.size()) + " plants\n";
+    else
+        text_to_display += std::to_string(static_cast<unsigned int>(frame.food.get_total_biomass())) + " food\n";
+    text_to_display += std::to_string(frame.creature_positions.size()) + " creatures\n";
+#if PROFILER_ENABLED
+    text_to_display += Profiler::get().format_summary();
+#endif
     stat_text.setString(text_to_display);
     stat_text.setFont(global_font);
     window_->draw(stat_text);
 
     window_->display();
 }
+
+void WindowManager::add_food_field(const FoodField& food)
+{
+    // Fuller cells are drawn more opaque; nearly bare ones not at all.
+    const sf::Vector2f cell_size(food.get_cell_size(), food.get_cell_size());
+    for(size_t row = 0; row < food.get_rows(); row++)
+        for(size_t column = 0; column < food.get_columns(); column++)
+        {
+            const float fill = food.get_biomass(row * food.get_columns() + column) / FoodFieldSettings::capacity;
+            const auto alpha = static_cast<sf::Uint8>(fill * 160.0f);
+            if(alpha < 8)
+                continue;
+            sf::Color color = to_sf_color(PlantStore::color);
+            color.a = alpha;
+            shapes_.add_rectangle(food.get_cell_center(column, row), cell_size, 0.0f, color);
+        }
+}
+
+void WindowManager::add_plant(const FrameSnapshot& frame, const size_t i)
+{
+    const float size = frame.plant_sizes[i];
+    shapes_.add_circle(frame.plant_positions[i], size, sf::Color::White, to_sf_color(PlantStore::color), size * 0.25f);
+}
+
+void WindowManager::add_creature(const FrameSnapshot& frame, const size_t i)
+{
+    const float size = frame.creature_sizes[i];
+    const sf::Vector2f& position = frame.creature_positions[i];
+    const sf::Color color = to_sf_color(frame.creature_colors[i]);
+    
+#if DRAW_DEBUG_DATA
+    shapes_.add_rectangle(position, sf::Vector2f(size * 4.5f, size * 0.25f),
+        std::atan2(-frame.creature_orientations[i].y, frame.creature_orientations[i].x) / PI_F * 180.0f, color);
+#endif
+    
+    shapes_.add_circle(position, size, color, sf::Color::White, size * 0.25f);
+}
+
+#if DRAW_DEBUG_DATA
+void WindowManager::draw_creature_debug_data(const FrameSnapshot& frame, const size_t i)
+{
+    debug_text_.setPosition(frame.creature_positions[i]);
+    debug_text_.setString(sf::String(
+        "Energy: " + std::to_string(frame.creature_energies[i]) +
+        "\nIs Overlapping Plant: " + (frame.creature_near_plant[i] ? "True" : "False") +
+        "\nGene: " + std::to_string(frame.creature_genes[i]) +
+        "\nDiet: " + std::to_string(frame.creature_diets[i])
+    ));
+    window_->draw(debug_text_);
+}
+#endif
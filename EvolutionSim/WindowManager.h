@@ -1,6 +1,10 @@
 ﻿#pragma once
+#include <SFML/Graphics.hpp>
 #include "Common.h"
-#include "Creature.h"
+#include "FrameSnapshot.h"
+#include "ShapeBatch.h"
+
+extern sf::Font global_font;
 
 class WindowManager
 {
@@ -9,7 +13,23 @@ public:
     WindowManager();
     ~WindowManager();
     inline bool is_window_open() const{ return window_->isOpen(); }
-    void draw(const std::vector<Thing*>& things_in_world) const;
+    // Only ever from one thread at a time, which must have the window's context active.
+    void draw(const FrameSnapshot& frame);
+    // Circle detail, see ShapeBatchSettings::default_segments_per_pixel.
+    inline void set_segments_per_pixel(const float segments_per_pixel) { shapes_.set_segments_per_pixel(segments_per_pixel); }
 protected:
+    void add_plant(const FrameSnapshot& frame, const size_t i);
+    void add_food_field(const FoodField& food);
+    void add_creature(const FrameSnapshot& frame, const size_t i);
+#if DRAW_DEBUG_DATA
+    void draw_creature_debug_data(const FrameSnapshot& frame, const size_t i);
+#endif
+
     sf::RenderWindow* window_;
+    // Every food cell, plant and creature of a frame, drawn in one call.
+    ShapeBatch shapes_;
+    
+#if DRAW_DEBUG_DATA
+    sf::Text debug_text_;    
+#endif
 };